@@ -0,0 +1,134 @@
+/**
+ * @file celllist.h
+ * @brief Header file for the cell list used to find neighbouring particles in a periodic box
+ * @author Catyre
+ */
+
+#ifndef CELLLIST_H
+#define CELLLIST_H
+
+#include "core.h"
+#include <algorithm>
+#include <vector>
+
+namespace djinn {
+    /**
+     * Bins particles in a periodic box into cells at least one cutoff wide, so
+     * every pair closer than the cutoff lies in the same or an adjacent cell
+     * (through the periodic boundaries where needed). Finding all such pairs
+     * is then O(N) instead of checking every i < j.
+     *
+     * Separations follow the minimum image convention, so positions are
+     * expected to lie inside the box (or at most one box length outside it).
+     * A cutoff larger than half the box still works but degenerates towards
+     * the all-pairs search, and only the nearest image of each pair is seen.
+     */
+    class CellList {
+        protected:
+            // Side lengths of the periodic box, with its lower corner at the origin
+            Vec3 bounds;
+
+            // Interaction cutoff, and its square
+            real cutoff;
+            real cutoffSq;
+
+            // Number of cells along each axis, and the size of one cell
+            int cells[3];
+            Vec3 cellSize;
+
+            // Particle indices sorted by cell; cell c owns entries [cellStart[c], cellStart[c + 1])
+            std::vector<unsigned> cellStart;
+            std::vector<unsigned> sorted;
+
+            // Cell of each particle from the last build
+            std::vector<unsigned> cellOf;
+
+            // Positions the list was last built from
+            const Vec3 *positions;
+            unsigned count;
+
+            // Returns the cell containing the given position
+            unsigned cellIndex(const Vec3 &p) const;
+
+            // Fills out with the distinct cells adjacent to (and including) the given one, in
+            //      increasing order, and returns how many there are
+            unsigned neighbourCells(unsigned cell, unsigned *out) const;
+
+        public:
+            CellList() : cutoff(0), cutoffSq(0), positions(nullptr), count(0) { cells[0] = cells[1] = cells[2] = 1; }
+
+            CellList(const Vec3 &bounds, real cutoff) : CellList() { setBox(bounds, cutoff); }
+
+            // Sets the periodic box and the cutoff, choosing the cell grid to match
+            void setBox(const Vec3 &bounds, real cutoff);
+
+            // Bins the given positions. The array must outlive any pair queries.
+            void build(const Vec3 *positions, unsigned count);
+
+            // Applies the minimum image convention to a separation vector
+            Vec3 minimumImage(Vec3 r) const {
+                if (r.x > bounds.x * 0.5) r.x -= bounds.x;
+                else if (r.x < -bounds.x * 0.5) r.x += bounds.x;
+
+                if (r.y > bounds.y * 0.5) r.y -= bounds.y;
+                else if (r.y < -bounds.y * 0.5) r.y += bounds.y;
+
+                if (r.z > bounds.z * 0.5) r.z -= bounds.z;
+                else if (r.z < -bounds.z * 0.5) r.z += bounds.z;
+
+                return r;
+            }
+
+            /**
+             * Calls fn(i, j, r, rSq) exactly once for every pair of particles
+             * closer than the cutoff, where r is the minimum image of
+             * positions[i] - positions[j] and rSq its square magnitude.
+             */
+            template <typename PairFunction>
+            void forEachPair(PairFunction fn) const {
+                forEachPair(fn, 0, cellCount());
+            }
+
+            // As above, but only for the pairs owned by cells [firstCell, lastCell). Disjoint
+            //      ranges see disjoint pairs, so they can be searched on different threads.
+            template <typename PairFunction>
+            void forEachPair(PairFunction fn, unsigned firstCell, unsigned lastCell) const {
+                unsigned neighbours[27];
+
+                for (unsigned c = firstCell; c < lastCell; c++) {
+                    unsigned numNeighbours = neighbourCells(c, neighbours);
+
+                    // Each unordered pair of cells is visited once, from its lower index
+                    for (unsigned n = 0; n < numNeighbours; n++) {
+                        unsigned other = neighbours[n];
+                        if (other < c)
+                            continue;
+
+                        for (unsigned a = cellStart[c]; a < cellStart[c + 1]; a++) {
+                            unsigned i = sorted[a];
+                            const Vec3 &pi = positions[i];
+
+                            // Within a cell, only look at the particles after this one
+                            unsigned b = (other == c) ? a + 1 : cellStart[other];
+                            for (; b < cellStart[other + 1]; b++) {
+                                unsigned j = sorted[b];
+                                Vec3 r = minimumImage(pi - positions[j]);
+                                real rSq = r.squareMagnitude();
+
+                                if (rSq < cutoffSq)
+                                    fn(i, j, r, rSq);
+                            }
+                        }
+                    }
+                }
+            }
+
+            unsigned cellCount() const { return static_cast<unsigned>(cells[0] * cells[1] * cells[2]); }
+
+            real getCutoff() const { return cutoff; }
+
+            const Vec3 &getBounds() const { return bounds; }
+    }; // class CellList
+} // namespace djinn
+
+#endif // CELLLIST_H
@@ -0,0 +1,223 @@
+/**
+ * @file collider.h
+ * @brief Header file for static colliders and swept (continuous) collision tests
+ * @author Catyre
+ */
+
+#ifndef COLLIDER_H
+#define COLLIDER_H
+
+#include "core.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace djinn {
+    /**
+     * Immovable geometry that particles can be swept against. A swept test
+     * looks at the whole path a particle took during a step rather than
+     * only where it ended up, so fast particles can't pass through thin
+     * colliders between two frames.
+     */
+    class StaticCollider {
+        protected:
+            // How far behind the surface a sweep may start and still count as touching
+            real skin;
+
+        public:
+            StaticCollider() : skin(1e-4) {}
+
+            virtual ~StaticCollider() {}
+
+            /**
+             * Sweeps a sphere of the given radius along the straight path from
+             * start to end. If it first touches the collider at fraction t of
+             * the way (0 <= t <= 1) while moving into it, returns true and
+             * fills t and the surface normal at the point of impact. Spheres
+             * starting less than the skin depth inside the collider touch at
+             * t = 0; deeper ones are left to the contact generators.
+             */
+            virtual bool sweep(const Vec3 &start, const Vec3 &end, real radius, real &t, Vec3 &normal) const = 0;
+
+            /**
+             * If a sphere of the given radius at point overlaps the collider,
+             * returns true and fills how deep it is and the direction that
+             * pushes it out.
+             */
+            virtual bool penetration(const Vec3 &point, real radius, real &depth, Vec3 &normal) const = 0;
+
+            /**
+             * Fills the axis-aligned box around the collider. Returns false
+             * if it is unbounded (e.g. a plane).
+             */
+            virtual bool bounds(Vec3 &min, Vec3 &max) const = 0;
+
+            void setSkin(const real skin) { this->skin = skin; }
+
+            real getSkin() const { return skin; }
+    }; // class StaticCollider
+
+    /**
+     * A one-sided infinite plane: the points p with normal * p = offset.
+     * Particles only collide with it from the side the normal points to.
+     * PlaneCollider(Vec3(0, 1, 0)) is the swept counterpart of
+     * GroundContacts.
+     */
+    class PlaneCollider : public StaticCollider {
+        protected:
+            Vec3 normal;
+            real offset;
+
+        public:
+            // The normal is normalized here
+            PlaneCollider(const Vec3 &normal, const real offset = 0);
+
+            // Signed distance of a point from the plane
+            real distance(const Vec3 &point) const { return normal * point - offset; }
+
+            virtual bool sweep(const Vec3 &start, const Vec3 &end, real radius, real &t, Vec3 &normal) const;
+            virtual bool penetration(const Vec3 &point, real radius, real &depth, Vec3 &normal) const;
+            virtual bool bounds(Vec3 &, Vec3 &) const { return false; }
+
+            Vec3 getNormal() const { return normal; }
+
+            real getOffset() const { return offset; }
+    }; // class PlaneCollider
+
+    // A solid sphere
+    class SphereCollider : public StaticCollider {
+        protected:
+            Vec3 centre;
+            real radius;
+
+        public:
+            SphereCollider(const Vec3 &centre, const real radius);
+
+            virtual bool sweep(const Vec3 &start, const Vec3 &end, real radius, real &t, Vec3 &normal) const;
+            virtual bool penetration(const Vec3 &point, real radius, real &depth, Vec3 &normal) const;
+            virtual bool bounds(Vec3 &min, Vec3 &max) const;
+    }; // class SphereCollider
+
+    /**
+     * A solid axis-aligned box. Swept spheres are tested against the box
+     * grown by their radius, so they hit its edges and corners slightly
+     * early.
+     */
+    class BoxCollider : public StaticCollider {
+        protected:
+            Vec3 centre;
+            Vec3 halfSize;
+
+        public:
+            BoxCollider(const Vec3 &centre, const Vec3 &halfSize);
+
+            virtual bool sweep(const Vec3 &start, const Vec3 &end, real radius, real &t, Vec3 &normal) const;
+            virtual bool penetration(const Vec3 &point, real radius, real &depth, Vec3 &normal) const;
+            virtual bool bounds(Vec3 &min, Vec3 &max) const;
+    }; // class BoxCollider
+
+    /**
+     * A two-sided triangle, the building block of triangle meshes. Swept
+     * spheres are tested against the face only (the rounded edges are left
+     * to penetration()), which is exact for points and close enough for
+     * small radii.
+     */
+    class TriangleCollider : public StaticCollider {
+        protected:
+            Vec3 vertices[3];
+            Vec3 normal;
+
+            // Closest point of the triangle to point
+            Vec3 closestPoint(const Vec3 &point) const;
+
+        public:
+            TriangleCollider(const Vec3 &a, const Vec3 &b, const Vec3 &c);
+
+            virtual bool sweep(const Vec3 &start, const Vec3 &end, real radius, real &t, Vec3 &normal) const;
+            virtual bool penetration(const Vec3 &point, real radius, real &depth, Vec3 &normal) const;
+            virtual bool bounds(Vec3 &min, Vec3 &max) const;
+    }; // class TriangleCollider
+
+    /**
+     * A set of static colliders behind a bounding volume hierarchy. The
+     * hierarchy is built by build(), or by the first query after colliders
+     * are added if build() wasn't called again; queries then only test the
+     * colliders whose boxes touch the query, so a particle costs
+     * O(log colliders) instead of O(colliders). Unbounded colliders are kept
+     * apart and always tested.
+     *
+     * The set is itself a StaticCollider, so it can be handed to the world
+     * for swept tests or to StaticContacts for resting contacts.
+     */
+    class StaticColliderSet : public StaticCollider {
+        protected:
+            struct Node {
+                Vec3 min;
+                Vec3 max;
+
+                // Leaves own items[first .. first + count); inner nodes have count 0,
+                //      their left child right after them and their right child at first
+                unsigned first;
+                unsigned count;
+            };
+
+            // Colliders added with add(); not owned
+            std::vector<StaticCollider *> colliders;
+
+            // Triangles created by addMesh(); owned
+            std::vector<std::unique_ptr<TriangleCollider>> triangles;
+
+            // Bounded colliders in tree order, with their boxes and box centres
+            std::vector<const StaticCollider *> items;
+            std::vector<Vec3> itemMin;
+            std::vector<Vec3> itemMax;
+            std::vector<Vec3> itemCentre;
+
+            std::vector<const StaticCollider *> unbounded;
+            std::vector<Node> nodes;
+
+            // True when colliders were added since the hierarchy was last built
+            std::atomic<bool> dirty;
+            mutable std::mutex buildMutex;
+
+            // Builds the hierarchy if colliders were added since, so a query never misses them
+            void buildIfDirty() const;
+
+            // Builds the subtree over items[first .. first + count) and returns its node index
+            unsigned buildNode(unsigned first, unsigned count);
+
+            // Calls fn(collider) for every collider whose box overlaps [min, max], unbounded ones included
+            template <typename Function>
+            void query(const Vec3 &min, const Vec3 &max, Function fn) const;
+
+        public:
+            StaticColliderSet() : dirty(false) {}
+
+            // Adds a collider (not owned by the set)
+            void add(StaticCollider *collider);
+
+            /**
+             * Adds a triangle mesh given as a vertex array and triangleCount
+             * triples of vertex indices.
+             */
+            void addMesh(const Vec3 *vertices, const unsigned *indices, unsigned triangleCount);
+
+            void clear();
+
+            // Builds the hierarchy over everything added so far
+            void build();
+
+            unsigned size() const { return static_cast<unsigned>(colliders.size() + triangles.size()); }
+
+            // Earliest hit of any collider in the set
+            virtual bool sweep(const Vec3 &start, const Vec3 &end, real radius, real &t, Vec3 &normal) const;
+
+            // Deepest penetration of any collider in the set
+            virtual bool penetration(const Vec3 &point, real radius, real &depth, Vec3 &normal) const;
+
+            virtual bool bounds(Vec3 &min, Vec3 &max) const;
+    }; // class StaticColliderSet
+} // namespace djinn
+
+#endif // COLLIDER_H
@@ -11,10 +11,13 @@
 
 #include "precision.h"
 #include "raylib.h"
+#include "simd.h"
+#include <cstddef>
 #include <iostream>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <type_traits>
 #include <variant>
 
 namespace djinn {
@@ -41,23 +44,26 @@ namespace djinn {
             }
     };
 
-    class Vec3 {
+    // Vec3 is aligned to its full four-real width so one vector maps onto one
+    //      SIMD register (see simd.h); every arithmetic operator goes through those kernels
+    class alignas(4 * sizeof(real)) Vec3 {
         public:
             // Spatial coordinates
             real x;
             real y;
             real z;
 
-        private:
-            // Padding to ensure four word alignment
+            // Padding to ensure four word alignment. This is the fourth SIMD lane and is
+            //      always kept at zero so it never pollutes a dot product. It is public only
+            //      so that every member shares one access level, which keeps Vec3
+            //      standard-layout (the kernels rely on x, y, z, pad being laid out in order)
             real pad;
 
-        public:
             // Default constructor creates a 0 vector
-            Vec3() : x(0), y(0), z(0) {}
+            Vec3() : x(0), y(0), z(0), pad(0) {}
 
             // Constructor for when values are passed
-            Vec3(const real x, const real y, const real z) : x(x), y(y), z(z) {}
+            Vec3(const real x, const real y, const real z) : x(x), y(y), z(z), pad(0) {}
 
             void invert() {
                 x = -x;
@@ -82,11 +88,11 @@ namespace djinn {
             }
 
             // Get magnitude of vector
-            real magnitude() const { return real_sqrt(x * x + y * y + z * z); }
+            real magnitude() const { return real_sqrt(simd::dot(&x, &x)); }
 
             // Sometimes it is useful and faster to just have the square of the
             // magnitude
-            real squareMagnitude() const { return x * x + y * y + z * z; }
+            real squareMagnitude() const { return simd::dot(&x, &x); }
 
             // Normalize a non-zero vector
             // void normalize() {
@@ -99,7 +105,7 @@ namespace djinn {
             Vec3 normalize() {
                 real l = magnitude();
                 if (l > 0) {
-                    return (*this) * ((real)1) / l;
+                    return (*this) * (((real)1) / l);
                 }
 
                 return Vec3(0, 0, 0);
@@ -107,14 +113,14 @@ namespace djinn {
 
             // Multiplies vector by given scalar
             void operator*=(const real scalar) {
-                x *= scalar;
-                y *= scalar;
-                z *= scalar;
+                simd::scale(&x, &x, scalar);
             }
 
             // Returns vector scaled by value
             Vec3 operator*(const real value) const {
-                return Vec3(x * value, y * value, z * value);
+                Vec3 result;
+                simd::scale(&result.x, &x, value);
+                return result;
             }
 
             Vec3 operator/(const real value) const {
@@ -129,20 +135,18 @@ namespace djinn {
 
             // Adds given vector
             Vec3 operator+(const Vec3 &v) const {
-                return Vec3(x + v.x, y + v.y, z + v.z);
+                Vec3 result;
+                simd::add(&result.x, &x, &v.x);
+                return result;
             }
 
             void operator+=(const Vec3 &v) {
-                x += v.x;
-                y += v.y;
-                z += v.z;
+                simd::add(&x, &x, &v.x);
             }
 
             // Subtracts given vector
             void operator-=(const Vec3 &v) {
-                x -= v.x;
-                y -= v.y;
-                z -= v.z;
+                simd::sub(&x, &x, &v.x);
             }
 
             bool operator==(const Vec3 &v) const {
@@ -152,53 +156,52 @@ namespace djinn {
             bool operator!=(const Vec3 &v) { return !(*this == v); }
 
             Vec3 operator-(const Vec3 &v) const {
-                return Vec3(x - v.x, y - v.y, z - v.z);
+                Vec3 result;
+                simd::sub(&result.x, &x, &v.x);
+                return result;
             }
 
             // Adds a given scaled vector
             void addScaledVector(const Vec3 &v, real scale) {
-                x += (v.x * scale);
-                y += (v.y * scale);
-                z += (v.z * scale);
+                simd::addScaled(&x, &v.x, scale);
             }
 
             // Calculate COMPONENT product of this vector with a given one
             Vec3 componentProduct(const Vec3 &v) const {
-                return Vec3(x * v.x, y * v.y, z * v.z);
+                Vec3 result;
+                simd::mul(&result.x, &x, &v.x);
+                return result;
             }
 
             void componentProductUpdate(const Vec3 &v) {
-                x *= v.x;
-                y *= v.y;
-                z *= v.z;
+                simd::mul(&x, &x, &v.x);
             }
 
             // Calculates and returns scalar product of this vector with given
             // vector
             real scalarProduct(const Vec3 &v) const {
-                return x * v.x + y * v.y + z * v.z;
+                return simd::dot(&x, &v.x);
             }
 
             real operator*(const Vec3 &v) const {
-                return x * v.x + y * v.y + z * v.z;
+                return simd::dot(&x, &v.x);
             }
 
             // Calculate vector product of this vector and a given vector
             Vec3 vectorProduct(const Vec3 &v) const {
-                return Vec3(y * v.z - z * v.y, z * v.x - x * v.z,
-                            x * v.y - y * v.x);
+                Vec3 result;
+                simd::cross(&result.x, &x, &v.x);
+                return result;
             }
 
             // Updates this vector to be the vector product of its current value
             // and the given vector
-            void operator%=(const Vec3 &v) { *this = vectorProduct(v); }
+            void operator%=(const Vec3 &v) { simd::cross(&x, &x, &v.x); }
 
             // Calculates and returns the vector product of this vector with the
             // given vector
             Vec3 operator%(const Vec3 &v) const {
-                return Vec3(y * v.z - z * v.y,
-                            z * v.x - x * v.z,
-                            x * v.y - y * v.x);
+                return vectorProduct(v);
             }
 
             bool operator<(const Vec3 &v) const {
@@ -232,6 +235,61 @@ namespace djinn {
             }
     }; // class Vec3
 
+    static_assert(sizeof(Vec3) == 4 * sizeof(real), "Vec3 must be exactly one four-lane SIMD vector wide");
+    static_assert(std::is_standard_layout<Vec3>::value, "The SIMD kernels read a Vec3 as an array of four reals");
+    static_assert(offsetof(Vec3, y) == sizeof(real) && offsetof(Vec3, z) == 2 * sizeof(real) &&
+                      offsetof(Vec3, pad) == 3 * sizeof(real),
+                  "The SIMD kernels read a Vec3 as x, y, z, pad");
+
+    namespace simd {
+        // Batch helpers over arrays of Vec3. Each vector is one four-lane register, so
+        //      these loops stream through the arrays one register at a time.
+
+        inline void add(Vec3 *out, const Vec3 *a, const Vec3 *b, unsigned count) {
+            for (unsigned i = 0; i < count; i++)
+                add(&out[i].x, &a[i].x, &b[i].x);
+        }
+
+        inline void sub(Vec3 *out, const Vec3 *a, const Vec3 *b, unsigned count) {
+            for (unsigned i = 0; i < count; i++)
+                sub(&out[i].x, &a[i].x, &b[i].x);
+        }
+
+        inline void scale(Vec3 *out, const Vec3 *a, real s, unsigned count) {
+            for (unsigned i = 0; i < count; i++)
+                scale(&out[i].x, &a[i].x, s);
+        }
+
+        // out[i] += v[i] * s
+        inline void addScaled(Vec3 *out, const Vec3 *v, real s, unsigned count) {
+            for (unsigned i = 0; i < count; i++)
+                addScaled(&out[i].x, &v[i].x, s);
+        }
+
+        inline void dot(real *out, const Vec3 *a, const Vec3 *b, unsigned count) {
+            for (unsigned i = 0; i < count; i++)
+                out[i] = dot(&a[i].x, &b[i].x);
+        }
+
+        inline void cross(Vec3 *out, const Vec3 *a, const Vec3 *b, unsigned count) {
+            for (unsigned i = 0; i < count; i++)
+                cross(&out[i].x, &a[i].x, &b[i].x);
+        }
+
+        inline void magnitude(real *out, const Vec3 *a, unsigned count) {
+            for (unsigned i = 0; i < count; i++)
+                out[i] = real_sqrt(dot(&a[i].x, &a[i].x));
+        }
+
+        // Zero vectors are left as zero
+        inline void normalize(Vec3 *out, const Vec3 *a, unsigned count) {
+            for (unsigned i = 0; i < count; i++) {
+                real l = real_sqrt(dot(&a[i].x, &a[i].x));
+                scale(&out[i].x, &a[i].x, l > 0 ? ((real)1) / l : 0);
+            }
+        }
+    } // namespace simd
+
     class VecN : public Vec3, public Vec2 {
         public:
             std::optional<real> vec1;
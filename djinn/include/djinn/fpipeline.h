@@ -0,0 +1,72 @@
+/**
+ * @file fpipeline.h
+ * @brief Header file for force pipelines, which fuse several force generators into one pass
+ * @author Catyre
+ */
+
+#ifndef FPIPELINE_H
+#define FPIPELINE_H
+
+#include "core.h"
+#include "particle.h"
+#include "pfgen.h"
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace djinn {
+    /**
+     * Applies a set of force generators known at compile time in a single
+     * pass over the particles. The generators are held by value and called
+     * through their (non-virtual) calculateForce(), so the compiler can
+     * inline all of them: each particle is read once, its net force summed
+     * locally and written with a single addForce().
+     *
+     * Any type with a Vec3 calculateForce(const Particle *) const works,
+     * e.g. ParticleEarthGravity, ParticleDrag and ParticleUplift:
+     *
+     *     ForcePipeline<ParticleEarthGravity, ParticleDrag> forces(
+     *         ParticleEarthGravity(Vec3(0, -9.8, 0)), ParticleDrag(0.1, 0.01));
+     *     forces.apply(particles);
+     *
+     * The pipeline is also a ParticleForceGenerator, so it can be registered
+     * in a ParticleForceRegistry in place of its generators; the registry
+     * then makes one updateForces() call for all of its particles.
+     */
+    template <typename... Generators>
+    class ForcePipeline : public ParticleForceGenerator {
+        protected:
+            std::tuple<Generators...> generators;
+
+        public:
+            ForcePipeline(const Generators &...generators) : generators(generators...) {}
+
+            // The I-th generator, e.g. to change its parameters between steps
+            template <std::size_t I>
+            typename std::tuple_element<I, std::tuple<Generators...>>::type &get() { return std::get<I>(generators); }
+
+            // Net force of all the generators on the given particle
+            Vec3 calculateForce(const Particle *particle) const {
+                Vec3 force;
+                std::apply([&](const Generators &...generator) { ((force += generator.calculateForce(particle)), ...); },
+                           generators);
+                return force;
+            }
+
+            // Applies the net force to each awake particle
+            void apply(Particle **particles, unsigned count) {
+                for (unsigned i = 0; i < count; i++) {
+                    if (particles[i]->getAwake())
+                        particles[i]->addForce(calculateForce(particles[i]));
+                }
+            }
+
+            void apply(std::vector<Particle *> &particles) { apply(particles.data(), static_cast<unsigned>(particles.size())); }
+
+            virtual void updateForce(Particle *particle, real duration) { particle->addForce(calculateForce(particle)); }
+
+            virtual void updateForces(Particle **particles, unsigned count, real duration) { apply(particles, count); }
+    }; // class ForcePipeline
+} // namespace djinn
+
+#endif // FPIPELINE_H
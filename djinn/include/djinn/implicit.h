@@ -0,0 +1,124 @@
+/**
+ * @file implicit.h
+ * @brief Header file for the implicit (backward Euler) integrator for spring networks
+ * @author Catyre
+ */
+
+#ifndef IMPLICIT_H
+#define IMPLICIT_H
+
+#include "core.h"
+#include "parallel.h"
+#include "psprings.h"
+#include <vector>
+
+namespace djinn {
+    /**
+     * Integrates the particles of a SpringNetwork with backward Euler, so
+     * stiff springs stay stable at steps far longer than their period.
+     * Following Baraff and Witkin's "Large Steps in Cloth Simulation", each
+     * step linearizes the spring forces about the current positions and
+     * solves
+     *
+     *     (M - h^2 K) dv = h (f + h K v)
+     *
+     * for the change in velocity, where K is the Jacobian of the spring
+     * forces. K is never assembled: the conjugate gradient solver only
+     * needs products with it, which are one sweep over the springs' 3x3
+     * blocks. The solve is preconditioned with the diagonal of the system
+     * and warm started from the previous step's dv.
+     *
+     * Compressed springs contribute only along their length to K (their
+     * sideways term would make the system indefinite), which damps
+     * buckling slightly but keeps the solver robust. Backward Euler also
+     * damps fast oscillations in general; that is the price of the large
+     * steps.
+     */
+    class ImplicitSpringSolver {
+        protected:
+            // Symmetric 3x3 block of the spring force Jacobian
+            struct Block {
+                real xx, xy, xz, yy, yz, zz;
+            };
+
+            static Vec3 multiply(const Block &m, const Vec3 &v);
+
+            SpringNetwork *network;
+
+            unsigned maxIterations;
+
+            // Relative residual the conjugate gradient solve stops at
+            real tolerance;
+
+            // Working state of the particles during a step
+            std::vector<Vec3> velocities;
+            std::vector<Vec3> forces;
+            std::vector<real> masses;
+
+            // Jacobian block of each spring (d force on its first particle / d its position),
+            //      and of each anchored spring
+            std::vector<Block> jacobians;
+            std::vector<Block> anchoredJacobians;
+
+            // Diagonal of the system, inverted, for the preconditioner
+            std::vector<Vec3> inverseDiagonal;
+
+            // Conjugate gradient vectors; deltaV is kept as the next step's first guess
+            std::vector<Vec3> deltaV;
+            std::vector<Vec3> residual;
+            std::vector<Vec3> direction;
+            std::vector<Vec3> preconditioned;
+            std::vector<Vec3> product;
+
+            ForceAccumulator accumulator;
+
+            // Partial sums of the dot products, one per block, added in block order
+            std::vector<real> partials;
+
+            unsigned lastIterations;
+            real lastResidual;
+
+            // Fills forces with the spring forces (plus the particles' own net forces) and the Jacobian blocks
+            void evaluate();
+
+            // out = K v
+            void multiplyStiffness(const std::vector<Vec3> &v, std::vector<Vec3> &out);
+
+            // out = (M - h^2 K) v, with the rows of immovable particles left as v
+            void multiplySystem(const std::vector<Vec3> &v, std::vector<Vec3> &out, real h);
+
+            real dot(const std::vector<Vec3> &a, const std::vector<Vec3> &b);
+
+        public:
+            /**
+             * Integrates the given network's particles; the network is not
+             * owned. It should not also be in the world's spring networks,
+             * since the solver applies its forces itself.
+             */
+            ImplicitSpringSolver(SpringNetwork *network, unsigned maxIterations = 100, real tolerance = 1e-6)
+                : network(network), maxIterations(maxIterations), tolerance(tolerance), lastIterations(0),
+                  lastResidual(0) {}
+
+            void setMaxIterations(unsigned iterations) { maxIterations = iterations; }
+
+            void setTolerance(real tolerance) { this->tolerance = tolerance; }
+
+            // Returns true if the particle is moved by this solver
+            bool owns(const Particle *particle) const;
+
+            /**
+             * Advances every particle of the network by the given duration,
+             * using the spring forces plus its own net force and acceleration
+             * like ParticleWorld::integrate (and clearing them afterwards).
+             * Particles with infinite mass, and sleeping particles, are held
+             * where they are.
+             */
+            void step(real duration);
+
+            // Conjugate gradient iterations of the last step, and the relative residual it stopped at
+            unsigned getLastIterations() const { return lastIterations; }
+            real getLastResidual() const { return lastResidual; }
+    }; // class ImplicitSpringSolver
+} // namespace djinn
+
+#endif // IMPLICIT_H
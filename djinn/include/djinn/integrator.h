@@ -0,0 +1,127 @@
+/**
+ * @file integrator.h
+ * @brief Header file for the integrators the particle world can step its particles with
+ * @author Catyre
+ */
+
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "core.h"
+#include "pstore.h"
+
+namespace djinn {
+    /**
+     * Advances the active particles of a ParticleStore by one step, all in
+     * one batch. The acceleration of a particle is its stored acceleration
+     * plus its net force over its mass; particles with infinite mass are
+     * left alone.
+     *
+     * Some integrators need the forces at the new positions to finish a
+     * step. For these isTwoPhase() is true, and the world evaluates the
+     * forces again after integrate() and hands them to finish(). Those
+     * forces are then carried into the next step, so each step still costs
+     * one force evaluation.
+     */
+    class Integrator {
+        public:
+            virtual ~Integrator() {}
+
+            /**
+             * Steps the particles given the forces at their current positions,
+             * then clears their forces and accelerations like
+             * ParticleStore::integrate (a two-phase integrator may keep the
+             * accelerations until finish()).
+             */
+            virtual void integrate(ParticleStore &store, real duration) = 0;
+
+            // True if the step needs finish() with the forces at the new positions
+            virtual bool isTwoPhase() const { return false; }
+
+            // Completes a two-phase step given the forces at the new positions, leaving them in the store
+            virtual void finish(ParticleStore &, real) {}
+
+            // Forgets any state carried between steps (e.g. after teleporting the particles)
+            virtual void reset() {}
+
+            // How far the particles' velocities trail their velocity at the positions' time, in
+            //      kicks of the whole step: that velocity is v + lag * a * duration. startLag() is
+            //      for the start of the last step, endLag() for after integrate() (before finish())
+            virtual real startLag() const { return 0; }
+            virtual real endLag() const { return 0; }
+
+            /**
+             * Moves one particle over part of a step, from its velocity at the
+             * positions' time, with the acceleration integrate() used, the way
+             * integrate() moves it (the world uses it to finish the step of a
+             * particle that a swept collision stopped partway). The default is
+             * the constant-acceleration step of ParticleStore::integrate.
+             */
+            virtual void restep(Vec3 &position, Vec3 &velocity, const Vec3 &acceleration, real duration) const;
+    }; // class Integrator
+
+    /**
+     * Kicks the velocity with the acceleration, then drifts the position
+     * with the new velocity. First order, but symplectic: energy stays
+     * bounded instead of drifting like with explicit Euler.
+     */
+    class SemiImplicitEuler : public Integrator {
+        public:
+            virtual void integrate(ParticleStore &store, real duration);
+
+            virtual void restep(Vec3 &position, Vec3 &velocity, const Vec3 &acceleration, real duration) const;
+    }; // class SemiImplicitEuler
+
+    /**
+     * Leapfrog in kick-drift-kick form, with the closing half kick of each
+     * step merged into the opening half kick of the next: the first step
+     * kicks by half a step, every later one by a whole step. The update is
+     * then the same as SemiImplicitEuler's, but velocities sit half a step
+     * behind the positions, which makes it second order.
+     *
+     * The particles' velocities are therefore half-step velocities; their
+     * velocity at the positions' time is v + a dt / 2, with a the
+     * acceleration at the current positions.
+     */
+    class LeapfrogIntegrator : public Integrator {
+        protected:
+            // True once the opening half kick has been taken
+            bool started;
+
+            // Lag of the velocities at the start of the last step (none before the opening kick)
+            real lastStartLag;
+
+        public:
+            LeapfrogIntegrator() : started(false), lastStartLag(0) {}
+
+            virtual void integrate(ParticleStore &store, real duration);
+
+            virtual void reset() { started = false; }
+
+            virtual real startLag() const { return lastStartLag; }
+            virtual real endLag() const { return 0.5; }
+    }; // class LeapfrogIntegrator
+
+    /**
+     * Velocity Verlet in its two-phase form: a half kick with the old
+     * acceleration and a drift, then (once the world has evaluated the
+     * forces at the new positions) a half kick with the new acceleration.
+     * Second order, with positions and velocities in step.
+     *
+     * A particle's stored acceleration counts for the whole step: it is
+     * part of both half kicks, and cleared by finish().
+     */
+    class VelocityVerlet : public Integrator {
+        public:
+            virtual void integrate(ParticleStore &store, real duration);
+
+            virtual bool isTwoPhase() const { return true; }
+
+            virtual void finish(ParticleStore &store, real duration);
+
+            // The closing half kick is left to finish()
+            virtual real endLag() const { return 0.5; }
+    }; // class VelocityVerlet
+} // namespace djinn
+
+#endif // INTEGRATOR_H
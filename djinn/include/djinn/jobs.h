@@ -0,0 +1,162 @@
+/**
+ * @file jobs.h
+ * @brief Header file for the work-stealing job system shared by the engine
+ * @author Catyre
+ */
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace djinn {
+    /**
+     * A unit of work for the job system. Jobs may depend on other jobs, in
+     * which case they are only queued once everything they depend on has
+     * finished.
+     */
+    struct Job {
+        std::function<void()> function;
+
+        // Unfinished prerequisites, plus one until the job is submitted
+        std::atomic<unsigned> pending;
+
+        std::atomic<bool> finished;
+
+        // Jobs waiting on this one, guarded by mutex
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Job>> dependents;
+
+        Job(std::function<void()> function) : function(std::move(function)), pending(1), finished(false) {}
+    }; // struct Job
+
+    typedef std::shared_ptr<Job> JobHandle;
+
+    /**
+     * A fixed pool of worker threads, each with its own deque of jobs. A
+     * worker pops from the back of its own deque (most recently queued, so
+     * still warm in cache) and, when that is empty, steals from the front of
+     * another worker's deque. The thread that created the pool counts as
+     * worker 0 and runs jobs whenever it waits on one.
+     *
+     * With a single thread there are no workers and every job runs inline as
+     * soon as its prerequisites are done, which is exactly the serial order.
+     */
+    class JobSystem {
+        protected:
+            // One deque per worker; queues[0] also takes jobs from threads outside the pool
+            struct WorkQueue {
+                std::mutex mutex;
+                std::deque<JobHandle> jobs;
+            };
+
+            unsigned threads;
+            std::vector<std::unique_ptr<WorkQueue>> queues;
+            std::vector<std::thread> workers;
+
+            // Sleeping workers wait here for jobs to be queued
+            std::mutex sleepMutex;
+            std::condition_variable wake;
+            std::atomic<unsigned> queued;
+            std::atomic<bool> stopping;
+
+            void start(unsigned threads);
+            void stop();
+
+            void workerLoop(unsigned index);
+
+            // Puts a job whose prerequisites are all done on the current worker's deque
+            void enqueue(const JobHandle &job);
+
+            // Runs a job and releases its dependents
+            void execute(const JobHandle &job);
+
+            // Takes a job from the given worker's own deque, or steals one. Returns null if there is none.
+            JobHandle take(unsigned index);
+
+            // Index of the calling thread's deque
+            unsigned currentWorker() const;
+
+        public:
+            // Starts a pool with the given number of threads (0 uses every hardware thread)
+            explicit JobSystem(unsigned threads = 1);
+
+            ~JobSystem();
+
+            JobSystem(const JobSystem &) = delete;
+            JobSystem &operator=(const JobSystem &) = delete;
+
+            // Restarts the pool with a new number of threads; must not be called from inside a job
+            void setThreadCount(unsigned threads);
+
+            unsigned getThreadCount() const { return threads; }
+
+            // Creates a job that will not run until it is submitted
+            JobHandle create(std::function<void()> function);
+
+            // Makes job wait for prerequisite to finish. Call before submitting job.
+            void addDependency(const JobHandle &job, const JobHandle &prerequisite);
+
+            // Hands a job to the pool; it runs as soon as its prerequisites are done
+            void submit(const JobHandle &job);
+
+            // Creates and submits a job with no prerequisites
+            JobHandle run(std::function<void()> function);
+
+            // Blocks until the job has finished, running other jobs in the meantime
+            void wait(const JobHandle &job);
+
+            /**
+             * Splits [0, count) into `blocks` contiguous ranges and calls
+             * fn(begin, end, block) for each, returning when all are done. The
+             * first range runs on the calling thread. Ranges depend only on
+             * count and blocks, so per-block results combined in block order
+             * are deterministic.
+             */
+            template <typename BlockFunction>
+            void parallelFor(unsigned count, unsigned blocks, BlockFunction fn) {
+                blocks = std::max(1u, std::min(blocks, count));
+
+                if (blocks == 1 || threads == 1) {
+                    // Same ranges as the parallel path, in order
+                    for (unsigned b = 0; b < blocks; b++) {
+                        fn(blockBegin(count, blocks, b), blockBegin(count, blocks, b + 1), b);
+                    }
+                    return;
+                }
+
+                std::vector<JobHandle> jobs;
+                jobs.reserve(blocks - 1);
+
+                for (unsigned b = 1; b < blocks; b++) {
+                    unsigned begin = blockBegin(count, blocks, b);
+                    unsigned end = blockBegin(count, blocks, b + 1);
+                    jobs.push_back(run([&fn, begin, end, b]() { fn(begin, end, b); }));
+                }
+
+                fn(0u, blockBegin(count, blocks, 1), 0u);
+
+                for (const JobHandle &job : jobs) {
+                    wait(job);
+                }
+            }
+
+            // First index of block b when [0, count) is split into the given number of blocks
+            static unsigned blockBegin(unsigned count, unsigned blocks, unsigned b) {
+                return static_cast<unsigned>(static_cast<unsigned long long>(count) * b / blocks);
+            }
+
+            // The engine-wide pool used by the registries, the world and the contact generators
+            static JobSystem &getInstance();
+    }; // class JobSystem
+} // namespace djinn
+
+#endif // JOBS_H
@@ -0,0 +1,121 @@
+/**
+ * @file nlist.h
+ * @brief Header file for Verlet neighbour lists
+ * @author Catyre
+ */
+
+#ifndef NLIST_H
+#define NLIST_H
+
+#include "celllist.h"
+#include "core.h"
+#include <vector>
+
+namespace djinn {
+    /**
+     * A Verlet neighbour list for a periodic box. Every pair closer than
+     * cutoff + skin is stored once, per particle, when the list is built (using
+     * a cell list). As long as no particle has moved more than half the skin
+     * since then, no pair outside the list can have come within the cutoff, so
+     * the list is reused and only its pairs need distance checks.
+     */
+    class NeighbourList {
+        protected:
+            // Finds candidate pairs when the list is rebuilt (binned at cutoff + skin)
+            CellList cellList;
+
+            real cutoff;
+            real cutoffSq;
+            real skin;
+
+            // Neighbours of particle i are neighbours[firstNeighbour[i] .. firstNeighbour[i + 1])
+            std::vector<unsigned> firstNeighbour;
+            std::vector<unsigned> neighbours;
+
+            // Positions at the last rebuild, used to measure displacement
+            std::vector<Vec3> reference;
+
+            // Scratch list of candidate pairs used while rebuilding
+            std::vector<unsigned> pairScratch;
+
+            // False until built, or after invalidate()
+            bool valid;
+
+            // Statistics for tuning the skin
+            unsigned updates;
+            unsigned rebuilds;
+            real listLengthSum;
+
+            // Rebuilds the list from scratch
+            void rebuild(const Vec3 *positions, unsigned count);
+
+            // True if some particle has moved more than half the skin since the last rebuild
+            bool needsRebuild(const Vec3 *positions, unsigned count) const;
+
+        public:
+            NeighbourList() : cutoff(0), cutoffSq(0), skin(0), valid(false), updates(0), rebuilds(0), listLengthSum(0) {}
+
+            // Sets the periodic box, the interaction cutoff and the skin radius
+            void setBox(const Vec3 &bounds, real cutoff, real skin);
+
+            // Forces a rebuild on the next update (e.g. when particles are added or removed)
+            void invalidate() { valid = false; }
+
+            /**
+             * Brings the list up to date with the given positions, rebuilding it
+             * only if needed. Returns true if the list was rebuilt.
+             */
+            bool update(const Vec3 *positions, unsigned count);
+
+            /**
+             * Calls fn(i, j, r, rSq) exactly once for every listed pair that is
+             * currently closer than the cutoff, where r is the minimum image of
+             * positions[i] - positions[j]. Call update() first.
+             */
+            template <typename PairFunction>
+            void forEachPair(const Vec3 *positions, PairFunction fn) const {
+                forEachPair(positions, fn, 0, getParticleCount());
+            }
+
+            // As above, but only for the pairs listed under particles [first, last). Disjoint
+            //      ranges see disjoint pairs, so they can be searched on different threads.
+            template <typename PairFunction>
+            void forEachPair(const Vec3 *positions, PairFunction fn, unsigned first, unsigned last) const {
+                for (unsigned i = first; i < last; i++) {
+                    const Vec3 &pi = positions[i];
+
+                    for (unsigned k = firstNeighbour[i]; k < firstNeighbour[i + 1]; k++) {
+                        unsigned j = neighbours[k];
+                        Vec3 r = cellList.minimumImage(pi - positions[j]);
+                        real rSq = r.squareMagnitude();
+
+                        if (rSq < cutoffSq)
+                            fn(i, j, r, rSq);
+                    }
+                }
+            }
+
+            // Number of times update() has been called
+            unsigned getUpdateCount() const { return updates; }
+
+            // Number of times the list has actually been rebuilt
+            unsigned getRebuildCount() const { return rebuilds; }
+
+            // Number of particles the list was last built for
+            unsigned getParticleCount() const {
+                return firstNeighbour.empty() ? 0 : static_cast<unsigned>(firstNeighbour.size()) - 1;
+            }
+
+            // Number of pairs currently stored
+            unsigned getPairCount() const { return static_cast<unsigned>(neighbours.size()); }
+
+            // Average number of stored pairs per particle over all rebuilds (each pair is stored once)
+            real getAverageListLength() const;
+
+            void resetStatistics();
+
+            real getSkin() const { return skin; }
+    }; // class NeighbourList
+} // namespace djinn
+
+#endif // NLIST_H
@@ -19,6 +19,10 @@ namespace djinn {
 
     // Loup Verlet algorithm
     void verletAlgorithm(Vec3 &x, Vec3 &v, Vec3 a, real dt);
+
+    // Loup Verlet algorithm over contiguous arrays of particle state. Entries with a
+    //      non-positive inverse mass are left untouched.
+    void verletAlgorithm(Vec3 *x, Vec3 *v, const Vec3 *a, const real *inverseMass, unsigned count, real dt);
 } // namespace djinn
 
 #endif // NUMERICAL_H
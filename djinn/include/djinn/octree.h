@@ -0,0 +1,86 @@
+/**
+ * @file octree.h
+ * @brief Header file for the Barnes-Hut octree used to approximate long range forces
+ * @author Catyre
+ */
+
+#ifndef OCTREE_H
+#define OCTREE_H
+
+#include "core.h"
+#include <vector>
+
+namespace djinn {
+    /**
+     * A Barnes-Hut octree over a set of point masses. The tree is rebuilt
+     * from scratch by build() whenever the bodies move, after which the
+     * inverse-square field acting on any body can be evaluated in
+     * O(log N) by replacing distant groups of bodies with their centre
+     * of mass.
+     */
+    class Octree {
+        protected:
+            struct Node {
+                // Geometric centre and half the side length of the cube
+                Vec3 centre;
+                real halfWidth;
+
+                // Total mass and centre of mass of every body below this node
+                Vec3 centreOfMass;
+                real mass;
+
+                // Index of each child node, or -1 if that octant is empty
+                int children[8];
+
+                // Range of this node's bodies in the body index list
+                unsigned first;
+                unsigned count;
+
+                bool isLeaf() const { return children[0] < 0 && children[1] < 0 && children[2] < 0 && children[3] < 0 &&
+                                             children[4] < 0 && children[5] < 0 && children[6] < 0 && children[7] < 0; }
+            };
+
+            // Holds the nodes of the tree, the root is always nodes[0]
+            std::vector<Node> nodes;
+
+            // Body indices, ordered so that every node owns a contiguous range
+            std::vector<unsigned> bodies;
+
+            // Scratch space used to partition bodies into octants
+            std::vector<unsigned> scratch;
+
+            // The body data the tree was last built from
+            const Vec3 *positions;
+            const real *masses;
+
+            // Recursively subdivides the given range of bodies, returning the node index
+            int buildNode(const Vec3 &centre, real halfWidth, unsigned first, unsigned count, unsigned depth);
+
+        public:
+            // Nodes holding this many bodies or fewer are not subdivided further
+            static const unsigned LEAF_SIZE = 1;
+
+            // Bound on the depth of the tree, so coincident bodies can't recurse forever
+            static const unsigned MAX_DEPTH = 32;
+
+            Octree() : positions(nullptr), masses(nullptr) {}
+
+            // Builds the tree over the given bodies. The arrays must outlive any field queries.
+            void build(const Vec3 *positions, const real *masses, unsigned count);
+
+            /**
+             * Returns sum(m_k * (r - r_k) / |r - r_k|^3) over every body k other
+             * than the given one. Multiplying by -G * m gives the gravitational
+             * force on the body. A node of width s at distance d is treated as a
+             * single mass when s / d < theta; theta = 0 gives the exact sum.
+             */
+            Vec3 field(unsigned body, real theta) const;
+
+            // Number of nodes in the tree after the last build
+            unsigned nodeCount() const { return static_cast<unsigned>(nodes.size()); }
+
+            void clear();
+    }; // class Octree
+} // namespace djinn
+
+#endif // OCTREE_H
@@ -0,0 +1,71 @@
+/**
+ * @file parallel.h
+ * @brief Helpers for splitting force evaluation across threads
+ * @author Catyre
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "core.h"
+#include "jobs.h"
+#include <vector>
+
+namespace djinn {
+    // Sets the number of threads in the engine-wide job system (0 uses every hardware
+    //      thread). The default is 1, which runs everything on the calling thread.
+    void setThreadCount(unsigned threads);
+
+    unsigned getThreadCount();
+
+    /**
+     * Splits [0, count) into `blocks` contiguous ranges and calls
+     * fn(begin, end, block) for each on the engine-wide job system (see
+     * JobSystem::parallelFor). Ranges depend only on count and blocks, so
+     * work that keeps per-block results and combines them in block order
+     * gives the same answer on every run.
+     */
+    template <typename BlockFunction>
+    void parallelFor(unsigned count, unsigned blocks, BlockFunction fn) {
+        JobSystem::getInstance().parallelFor(count, blocks, fn);
+    }
+
+    // parallelFor() with one block per thread
+    template <typename BlockFunction>
+    void parallelFor(unsigned count, BlockFunction fn) {
+        parallelFor(count, getThreadCount(), fn);
+    }
+
+    /**
+     * One force buffer (and energy total) per block of a parallelFor(), so
+     * that blocks working on different pairs can write to the same particle
+     * without locking. The buffers are summed in block order by reduce(),
+     * which keeps the result deterministic for a given thread count.
+     */
+    class ForceAccumulator {
+        protected:
+            unsigned threads;
+            unsigned count;
+
+            // Buffer of thread t is forces[t * count .. (t + 1) * count)
+            std::vector<Vec3> forces;
+            std::vector<real> energies;
+
+        public:
+            ForceAccumulator() : threads(0), count(0) {}
+
+            // Sizes the buffers for the given number of threads and particles and zeroes them
+            void reset(unsigned threads, unsigned count);
+
+            Vec3 *getForces(unsigned thread) { return forces.data() + static_cast<size_t>(thread) * count; }
+
+            real &getEnergy(unsigned thread) { return energies[thread]; }
+
+            // Writes the summed force on each particle to out (count entries) and returns the summed energy
+            real reduce(Vec3 *out) const;
+
+            unsigned getThreadCount() const { return threads; }
+    }; // class ForceAccumulator
+} // namespace djinn
+
+#endif // PARALLEL_H
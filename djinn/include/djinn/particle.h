@@ -11,7 +11,20 @@
 #include <iostream>
 
 namespace djinn {
+    class ParticleStore;
+
+    /**
+     * A point mass. On its own a particle keeps its state in its own
+     * fields; once bound to a ParticleStore (as the particles of a
+     * ParticleWorld are), its hot state (position, velocity, acceleration,
+     * net force, inverse mass and damping) lives in the store's arrays and
+     * the particle is a handle to its slot there. Either way it is read
+     * and written through the same methods.
+     */
     class Particle {
+        // The particle store binds particles to its slots and moves their state in and out
+        friend class ParticleStore;
+
         protected:
             // In some systems it is useful to name the particles
             std::string name;
@@ -37,16 +50,55 @@ namespace djinn {
             Vec3 netForce;
             real netPotential;
 
+            // Sleeping particles are skipped by the world until something wakes them
+            bool isAwake;
+
+            // Some particles (e.g. ones the user moves by hand) should never be put to sleep
+            bool canSleep;
+
+            // The store holding the hot state while the particle is bound to one, and its slot
+            //      there; the own fields above are stale while bound
+            ParticleStore *store;
+            unsigned slot;
+
+            // The hot state, wherever it currently lives
+            Vec3 &position();
+            const Vec3 &position() const;
+            Vec3 &velocity();
+            const Vec3 &velocity() const;
+            Vec3 &acceleration();
+            const Vec3 &acceleration() const;
+            Vec3 &force();
+            const Vec3 &force() const;
+            real &inverseMassRef();
+            real inverseMassRef() const;
+            real &dampingRef();
+            real dampingRef() const;
+
         public:
             Particle()
                 : pos(Vec3(0, 0, 0)), vel(Vec3(0, 0, 0)), acc(Vec3(0, 0, 0)),
-                  damping((real)1.0), inverseMass(1), name(""){};
+                  damping((real)1.0), inverseMass(1), netPotential(0), isAwake(true), canSleep(true), name(""),
+                  store(nullptr), slot(0){};
 
             Particle(const Vec3 pos, const Vec3 vel, const Vec3 acc,
                      const real damping, const real inverseMass,
                      const std::string name = "")
                 : pos(pos), vel(vel), acc(acc), damping(damping),
-                  inverseMass(inverseMass), name(name){};
+                  inverseMass(inverseMass), netPotential(0), isAwake(true), canSleep(true), name(name),
+                  store(nullptr), slot(0){};
+
+            // A copy has the same state, but is not bound to any store
+            Particle(const Particle &other);
+
+            // Assigns the state, leaving the particle bound to its store (if any)
+            Particle &operator=(const Particle &other);
+
+            // Leaves the store it is bound to
+            ~Particle();
+
+            // The store the particle is bound to, or null
+            ParticleStore *getStore() const { return store; }
 
             std::string toString();
 
@@ -92,6 +144,7 @@ namespace djinn {
 
             void clearNetPotential();
 
+            // Adds a force to the accumulator, waking the particle unless the force is zero
             void addForce(const Vec3 &f);
 
             void addPotential(const real potential);
@@ -100,13 +153,23 @@ namespace djinn {
 
             bool hasFiniteMass() const;
 
+            bool getAwake() const { return isAwake; }
+
+            // Putting a particle to sleep also stops it
+            void setAwake(const bool awake = true);
+
+            bool getCanSleep() const { return canSleep; }
+
+            // Forbidding sleep wakes the particle if it is asleep
+            void setCanSleep(const bool canSleep = true);
+
             // If the two particles have the same time derivatives, damping
             // factor, and mass, we assume them to be the same particle
             bool operator==(const Particle &p) const {
-                return (pos - p.pos).isZero() && (vel - p.vel).isZero() &&
-                       (acc - p.acc).isZero() &&
-                       (real_abs(damping - p.damping) < EPSILON) &&
-                       (real_abs(inverseMass - p.inverseMass) < EPSILON);
+                return (position() - p.position()).isZero() && (velocity() - p.velocity()).isZero() &&
+                       (acceleration() - p.acceleration()).isZero() &&
+                       (real_abs(dampingRef() - p.dampingRef()) < EPSILON) &&
+                       (real_abs(inverseMassRef() - p.inverseMassRef()) < EPSILON);
             }
 
             bool operator!=(const Particle &p) { return !(*this == p); }
@@ -0,0 +1,155 @@
+/**
+ * @file pcollide.h
+ * @brief Header file for particle-particle collision detection
+ * @author Catyre
+ */
+
+#ifndef PCOLLIDE_H
+#define PCOLLIDE_H
+
+#include "collider.h"
+#include "core.h"
+#include "pcontacts.h"
+#include <vector>
+
+namespace djinn {
+    /**
+     * A uniform grid over unbounded space, stored as a hash table of cells.
+     * Points are binned by their cell's integer coordinates, so with cells at
+     * least as wide as the largest interaction distance every interacting
+     * pair lies in the same or an adjacent cell. Unrelated cells may share a
+     * bucket; that only costs extra candidates, never missed pairs.
+     */
+    class SpatialHash {
+        protected:
+            real cellSize;
+            real inverseCellSize;
+
+            // Number of buckets minus one (the table size is a power of two)
+            unsigned mask;
+
+            // Point indices sorted by bucket; bucket b owns entries [bucketStart[b], bucketStart[b + 1])
+            std::vector<unsigned> bucketStart;
+            std::vector<unsigned> sorted;
+
+            // Bucket of each point from the last build
+            std::vector<unsigned> bucketOf;
+
+            // Integer cell coordinates of each point from the last build
+            std::vector<int> cells;
+
+            unsigned bucket(int x, int y, int z) const {
+                return (static_cast<unsigned>(x) * 73856093u ^ static_cast<unsigned>(y) * 19349663u ^
+                        static_cast<unsigned>(z) * 83492791u) & mask;
+            }
+
+        public:
+            SpatialHash() : cellSize(1), inverseCellSize(1), mask(0) {}
+
+            // Bins the points into cells of the given width
+            void build(const Vec3 *positions, unsigned count, real cellSize);
+
+            /**
+             * Fills out with the distinct buckets of the cells around (and
+             * including) the cell of point i, and returns how many there are
+             * (at most 27).
+             */
+            unsigned neighbourBuckets(unsigned i, unsigned *out) const;
+
+            // Points in bucket b are sorted[bucketBegin(b) .. bucketEnd(b))
+            unsigned bucketBegin(unsigned b) const { return bucketStart[b]; }
+            unsigned bucketEnd(unsigned b) const { return bucketStart[b + 1]; }
+            unsigned point(unsigned k) const { return sorted[k]; }
+
+            real getCellSize() const { return cellSize; }
+    }; // class SpatialHash
+
+    /**
+     * Generates contacts between overlapping particles, each treated as a
+     * sphere of its own radius. Candidate pairs come from a spatial hash
+     * rebuilt on every call, so the cost grows with the number of particles
+     * rather than the number of pairs.
+     */
+    class ParticleCollisions : public ParticleContactGenerator {
+        protected:
+            std::vector<Particle *> particles;
+            std::vector<real> radii;
+
+            // Restitution of every generated contact
+            real restitution;
+
+            // Width of the hash cells; 0 uses the largest diameter
+            real cellSize;
+
+            // Per-frame scratch space. addContact() is const in the generator
+            //      interface, but rebuilds these every time it is called.
+            mutable SpatialHash grid;
+            mutable std::vector<Vec3> positions;
+            mutable std::vector<std::vector<ParticleContact>> blockContacts;
+
+        public:
+            ParticleCollisions(real restitution = 0.5, real cellSize = 0)
+                : restitution(restitution), cellSize(cellSize) {}
+
+            // Adds a particle as a sphere of the given radius
+            void add(Particle *particle, real radius);
+
+            void remove(Particle *particle);
+
+            void clear();
+
+            void setRestitution(real restitution) { this->restitution = restitution; }
+
+            /**
+             * Writes a contact for every pair of overlapping particles, up to
+             * limit, with the normal pointing from the second particle to the
+             * first. Contacts come out in the same order whatever the thread
+             * count.
+             */
+            virtual unsigned addContact(ParticleContact *contact, unsigned limit) const;
+    }; // class ParticleCollisions
+
+    /**
+     * Generates contacts between particles, each treated as a sphere of its
+     * own radius, and static geometry (usually a StaticColliderSet, whose
+     * hierarchy keeps the cost per particle logarithmic in the number of
+     * colliders). The contacts have no second particle.
+     */
+    class StaticContacts : public ParticleContactGenerator {
+        protected:
+            std::vector<Particle *> particles;
+            std::vector<real> radii;
+
+            const StaticCollider *collider;
+
+            // Restitution of every generated contact
+            real restitution;
+
+            // Per-block scratch space, rebuilt on every call
+            mutable std::vector<std::vector<ParticleContact>> blockContacts;
+
+        public:
+            StaticContacts(const StaticCollider *collider = nullptr, real restitution = 0.5)
+                : collider(collider), restitution(restitution) {}
+
+            // Adds a particle as a sphere of the given radius
+            void add(Particle *particle, real radius);
+
+            void remove(Particle *particle);
+
+            void clear();
+
+            void setCollider(const StaticCollider *collider) { this->collider = collider; }
+
+            void setRestitution(real restitution) { this->restitution = restitution; }
+
+            /**
+             * Writes a contact for every particle overlapping the collider,
+             * up to limit, pushing it out along the collider's normal.
+             * Sleeping particles are skipped.
+             */
+            virtual unsigned addContact(ParticleContact *contact, unsigned limit) const;
+    }; // class StaticContacts
+} // namespace djinn
+
+#endif // PCOLLIDE_H
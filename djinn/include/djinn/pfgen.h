@@ -8,13 +8,30 @@
 #define PFGEN_H
 
 #include "core.h"
+#include "octree.h"
 #include "particle.h"
+#include "pstore.h"
 #include <vector>
 
 namespace djinn {
     class ParticleForceGenerator {
         public:
             virtual void updateForce(Particle *particle, real duration) = 0;
+
+            // Applies the force to count particles at once. The default calls updateForce() on each;
+            //      generators that treat every particle alike override it with one tight loop
+            virtual void updateForces(Particle **particles, unsigned count, real duration);
+
+            // Generators that treat every particle alike can also apply the force to slots
+            //      [begin, end) of a store straight from its contiguous arrays. The registry does so
+            //      when a generator's awake particles are exactly the particles bound to one store
+            virtual bool hasStoreForces() const { return false; }
+            virtual void updateStoreForces(ParticleStore *, unsigned, unsigned, real) {}
+
+            // The particle at the other end, for generators that couple two particles (springs).
+            //      A sleeping particle still feels the generator while the other end moves, and
+            //      the world puts both ends in one island
+            virtual Particle *getOther() const { return nullptr; }
     };
 
     // To be used for forces that apply universally to all particles in the system (gravity or electromagnetism, for example)
@@ -31,13 +48,44 @@ namespace djinn {
             typedef std::vector<ParticleUniversalForceRegistration> Registry;
             Registry registrations;
 
+            // True if gravity should be approximated with a Barnes-Hut octree rather than summed directly
+            bool barnesHut = false;
+
+            // Barnes-Hut opening angle (node width / distance below which a node is treated as one body)
+            real theta = 0.5;
+
+            // Octree and body data, rebuilt from the registrations on every applyGravity() call
+            Octree tree;
+            std::vector<Vec3> positions;
+            std::vector<real> masses;
+
+            // Force on each body, filled in parallel and applied afterwards
+            std::vector<Vec3> forces;
+
+            // Copies the registered bodies into positions and masses
+            void gatherBodies();
+
+            // O(N^2) pairwise summation
+            void applyGravityDirect();
+
+            // O(N log N) octree approximation
+            void applyGravityBarnesHut();
+
         public:
             void add(Particle *particle);
 
             void add(std::vector<Particle*> particles);
 
+            // Applies the mutual gravitational force between every pair of registered particles
             void applyGravity();
 
+            // Switch applyGravity() to the Barnes-Hut approximation with the given opening angle
+            //      (0 is exact, ~0.5 is a typical trade-off between speed and accuracy)
+            void useBarnesHut(real theta = 0.5);
+
+            // Switch applyGravity() back to exact pairwise summation (the default)
+            void useDirectSummation();
+
             void clear();
 
             void integrateAll(real duration);
@@ -53,7 +101,7 @@ namespace djinn {
                 ParticleForceGenerator *fg;
 
                 bool operator==(const ParticleForceRegistration& other) const{
-                    return particle == other.particle;
+                    return particle == other.particle && fg == other.fg;
                 }
             };
 
@@ -61,10 +109,33 @@ namespace djinn {
             typedef std::vector<ParticleForceRegistration> Registry;
             Registry registrations;
 
+            // Registered particles grouped by generator, generators in the order they were first
+            //      added; the particles of generators[g] are grouped[firstParticle[g] .. firstParticle[g + 1])
+            std::vector<ParticleForceGenerator *> generators;
+            std::vector<Particle *> grouped;
+            std::vector<unsigned> firstParticle;
+
+            // Every registered particle once, in the order they were first added
+            std::vector<Particle *> uniqueParticles;
+
+            // Awake particles of the generator being run
+            std::vector<Particle *> batch;
+
+            // The store every particle in the batch is bound to, or null if they aren't all bound
+            //      to one store or don't fill it
+            ParticleStore *batchStore() const;
+
+            // True when the grouping is out of date with the registrations
+            bool dirty = true;
+
+            // Rebuilds generators, grouped, firstParticle and uniqueParticles
+            void groupByGenerator();
+
         public:
             // Registers the given force generator to apply to the given particle
             void add(Particle* particle, ParticleForceGenerator *fg);
 
+            // Integrates every registered particle once, however many generators it has
             void integrateAll(real duration);
 
             // Removes given registered pair from registry
@@ -74,7 +145,17 @@ namespace djinn {
             void clear();
 
             // Calls all the force generators to update the forces of their corresponding particles
+            //      (sleeping particles are skipped, unless the generator's other end is moving, in
+            //      which case a non-zero force wakes them). Each generator is handed all of its particles in one
+            //      updateForces() call rather than one virtual call per registration. With more than one
+            //      thread (see setThreadCount()) a generator's particles are split across threads, so
+            //      generators must only write to the particles they are given.
             void updateForces(real duration);
+
+            // Number of registrations, and the particle and generator of each
+            unsigned size() const { return static_cast<unsigned>(registrations.size()); }
+            Particle *getParticle(unsigned registration) const { return registrations[registration].particle; }
+            ParticleForceGenerator *getGenerator(unsigned registration) const { return registrations[registration].fg; }
     }; // class ParticleForceRegistry
 
     // A force generator that applies a gravitational force.  One instance can be used for
@@ -86,8 +167,18 @@ namespace djinn {
             // Create generator with given acceleration
             ParticleEarthGravity(const Vec3& gravity);
 
+            // Gravitational force on the given particle (none if it is immovable)
+            Vec3 calculateForce(const Particle *particle) const {
+                return particle->hasFiniteMass() ? gravity * particle->getMass() : Vec3();
+            }
+
             // Applies the gravitational force to the given particle
             virtual void updateForce(Particle* particle, real duration);
+
+            virtual void updateForces(Particle **particles, unsigned count, real duration);
+
+            virtual bool hasStoreForces() const { return true; }
+            virtual void updateStoreForces(ParticleStore *store, unsigned begin, unsigned end, real duration);
     }; // class ParticleEarthGravity
 
     class ParticlePointGravity : public ParticleForceGenerator {
@@ -115,7 +206,18 @@ namespace djinn {
         public:
             ParticleDrag(real k1, real k2);
 
+            // Drag force on the given particle: -(k1 |v| + k2 |v|^2) v / |v|
+            Vec3 calculateForce(const Particle *particle) const {
+                Vec3 velocity = particle->getVelocity();
+                return velocity * -(k1 + k2 * velocity.magnitude());
+            }
+
             virtual void updateForce(Particle* particle, real duration);
+
+            virtual void updateForces(Particle **particles, unsigned count, real duration);
+
+            virtual bool hasStoreForces() const { return true; }
+            virtual void updateStoreForces(ParticleStore *store, unsigned begin, unsigned end, real duration);
     }; // class ParticleDrag
 
     class ParticleUplift : public ParticleForceGenerator {
@@ -125,6 +227,14 @@ namespace djinn {
         public:
             ParticleUplift(Vec3 origin, real radius);
 
+            // Uplift force on the given particle (none outside the radius)
+            Vec3 calculateForce(const Particle *particle) const {
+                Vec3 position = particle->getPosition();
+                real dx = position.x - origin.x;
+                real dz = position.z - origin.z;
+                return dx * dx + dz * dz < radius * radius ? Vec3(0, 1, 0) : Vec3();
+            }
+
             virtual void updateForce(Particle* particle, real duration);
     }; // class ParticleUplift
 
@@ -144,6 +254,8 @@ namespace djinn {
 
             virtual void updateForce(Particle* particle, real duration);
 
+            virtual Particle *getOther() const { return other; }
+
             real calcCritDamping(real mass);
     }; // class ParticleSpring
 
@@ -181,6 +293,8 @@ namespace djinn {
             ParticleBungee(Particle *other, real springConstant, real restLength);
 
             virtual void updateForce(Particle *particle, real duration);
+
+            virtual Particle *getOther() const { return other; }
     }; // class ParticleBungee
 
     class ParticleFakeSpring : public ParticleForceGenerator {
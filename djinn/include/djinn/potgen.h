@@ -8,17 +8,42 @@
 #define POTGEN_H
 
 #include "core.h"
+#include "djinn/celllist.h"
+#include "djinn/nlist.h"
+#include "djinn/parallel.h"
 #include "djinn/particle.h"
 #include "djinn/pfgen.h"
 #include <vector>
 
 namespace djinn {
+    // A span of interacting pairs handed to a potential generator in one call. For
+    //      pair k, r[k] = r_i - r_j between particles i[k] and j[k], and rSq[k] = |r[k]|^2
+    struct PairBatch {
+        const unsigned *i;
+        const unsigned *j;
+        const Vec3 *r;
+        const real *rSq;
+        unsigned count;
+    };
+
     class PotentialGenerator {
         public:
             // "var" is a generic variable representing whatever quantity is
             //      needed to calculate the potential (position/distance, time, etc.)
             virtual void updatePotential(Particle *particle, real var) = 0;
             virtual void updateForce(Particle *particle, Vec3 r_vec, real r_mag, real dvar) = 0;
+
+            // The pair interaction as a function of the squared separation. Sets
+            //      forceOverR = -(dU/dr) / r, so the force on i is r_vec * forceOverR, and
+            //      energy = U(r)
+            virtual void pairInteraction(real rSq, real &forceOverR, real &energy) const = 0;
+
+            // Evaluates every pair in the batch, adding each pair's force to forces[i]
+            //      and the equal and opposite force to forces[j]. If energies is given,
+            //      energies[k] is set to the energy of pair k. The default implementation
+            //      calls pairInteraction() per pair; generators override it with an
+            //      inlined kernel.
+            virtual void evaluate(const PairBatch &batch, Vec3 *forces, real *energies = nullptr) const;
     }; // class PotentialGenerator
 
     class PotentialRegistry {
@@ -38,6 +63,62 @@ namespace djinn {
             typedef std::vector<PotentialRegistration> Registry;
             Registry registrations;
 
+            // True if the particles live in a periodic box, searched with the cell list
+            bool periodic = false;
+            CellList cellList;
+
+            // True if pairs should come from a Verlet neighbour list rather than a fresh cell search
+            bool useNeighbours = false;
+            NeighbourList neighbourList;
+
+            // Positions of the registered particles, gathered for the pair search, and whether
+            //      each is free to move (awake with finite mass)
+            std::vector<Vec3> positions;
+            std::vector<char> moving;
+
+            // Applies the pair force between registrations i and j (r = r_i - r_j)
+            //      through each particle's updateForce; used when the two particles
+            //      have different generators
+            void applyPair(unsigned i, unsigned j, const Vec3 &r, real rSq, real dvar);
+
+            // Pairs are queued and handed to their generator in batches of this size
+            static const unsigned BATCH_SIZE = 512;
+
+            // Pair search state of one thread: the pending batch and the generator it
+            //      belongs to, plus the pairs with mixed generators, which go through
+            //      applyPair() after the threads have joined
+            struct PairWorker {
+                PotentialGenerator *generator = nullptr;
+                std::vector<unsigned> i;
+                std::vector<unsigned> j;
+                std::vector<Vec3> r;
+                std::vector<real> rSq;
+                std::vector<real> energies;
+
+                std::vector<unsigned> mixedI;
+                std::vector<unsigned> mixedJ;
+                std::vector<Vec3> mixedR;
+                std::vector<real> mixedRSq;
+            };
+
+            std::vector<PairWorker> workers;
+
+            // Per-thread force buffers the batches are evaluated into
+            ForceAccumulator accumulator;
+
+            // Net force on each registration, summed over the threads
+            std::vector<Vec3> forces;
+
+            // Total potential energy from the last updatePotentials()
+            real potentialEnergy = 0;
+
+            // Adds a pair to the worker's pending batch, evaluating the batch first if it
+            //      is full or belongs to another generator
+            void queuePair(unsigned thread, unsigned i, unsigned j, const Vec3 &r, real rSq);
+
+            // Evaluates the worker's pending batch into its thread's force buffer
+            void flushBatch(unsigned thread);
+
         public:
             PotentialRegistry() {
                 ParticleForceRegistry force_registry;
@@ -55,10 +136,30 @@ namespace djinn {
             // Clear all registrations from the registry
             void clear();
 
+            // Treat the registered particles as living in a periodic box (lower corner at
+            // the origin) and only let pairs closer than the cutoff interact. Pairs are
+            // then found with a cell list in O(N) rather than checking all of them.
+            void setPeriodicBox(const Vec3 &bounds, real cutoff);
+
+            // Keep a Verlet neighbour list of every pair within cutoff + skin and reuse it
+            // until some particle has moved more than skin / 2. Requires setPeriodicBox().
+            void useNeighbourList(real skin);
+
+            // Rebuild counts and list lengths, for tuning the skin
+            const NeighbourList &getNeighbourList() const { return neighbourList; }
+
             // Calls all the potential generators to update the forces of their
-            // corresponding particles
+            // corresponding particles. Each interacting pair is visited once; pairs
+            // whose particles share a generator are evaluated in batches, and both
+            // particles get equal and opposite forces. Pairs with neither particle
+            // moving are skipped, so a sleeping particle only feels moving
+            // neighbours, and their force wakes it. The search and the batches
+            // are split across getThreadCount() threads.
             void updatePotentials(real duration);
 
+            // Total potential energy of the pairs evaluated in the last updatePotentials()
+            real getPotentialEnergy() const { return potentialEnergy; }
+
     }; // class PotentialRegistry
 
     class LennardJones : public PotentialGenerator {
@@ -73,10 +174,56 @@ namespace djinn {
             virtual void updatePotential(Particle *particle, real var);
             virtual void updateForce(Particle *particle, Vec3 r_vec, real r_mag, real dvar);
 
-        private:
-            real sigma;
-            real epsilon;
+            virtual void pairInteraction(real rSq, real &forceOverR, real &energy) const;
+            virtual void evaluate(const PairBatch &batch, Vec3 *forces, real *energies = nullptr) const;
     }; // class LennardJones
+
+    /**
+     * A pair potential baked into a table at setup. The force and energy of the
+     * source generator are sampled on a uniform grid in r^2 between rMin and the
+     * cutoff and evaluated with natural cubic splines, so every pair costs one
+     * table lookup and a few multiply-adds however expensive the source is.
+     *
+     * Separations beyond the cutoff feel nothing. Separations closer than rMin
+     * get the values at rMin, so pick it below the closest approach expected.
+     */
+    class TabulatedPotential : public PotentialGenerator {
+        protected:
+            // Spline coefficients of one grid interval, in the interval's local
+            //      coordinate t in [0, 1): value = a + t * (b + t * (c + t * d))
+            struct Segment {
+                real forceA, forceB, forceC, forceD;
+                real energyA, energyB, energyC, energyD;
+            };
+
+            std::vector<Segment> segments;
+
+            real rMinSq;
+            real cutoffSq;
+
+            // Number of grid intervals per unit of r^2
+            real inverseSpacing;
+
+            // Fills the a, b, c, d coefficients of a natural cubic spline through the samples
+            static void fitSpline(const std::vector<real> &samples, real Segment::*a, real Segment::*b,
+                                  real Segment::*c, real Segment::*d, std::vector<Segment> &out);
+
+        public:
+            /**
+             * Tabulates source between rMin and cutoff using the given number of
+             * grid intervals. The source is only read here; it need not outlive
+             * the table.
+             */
+            TabulatedPotential(const PotentialGenerator &source, real rMin, real cutoff, unsigned intervals = 2048);
+
+            virtual void updatePotential(Particle *particle, real var);
+            virtual void updateForce(Particle *particle, Vec3 r_vec, real r_mag, real dvar);
+
+            virtual void pairInteraction(real rSq, real &forceOverR, real &energy) const;
+            virtual void evaluate(const PairBatch &batch, Vec3 *forces, real *energies = nullptr) const;
+
+            real getCutoff() const { return real_sqrt(cutoffSq); }
+    }; // class TabulatedPotential
 } // namespace djinn
 
 #endif // POTGEN_H
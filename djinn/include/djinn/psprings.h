@@ -0,0 +1,117 @@
+/**
+ * @file psprings.h
+ * @brief Header file for spring networks, which apply the forces of many springs in one sweep
+ * @author Catyre
+ */
+
+#ifndef PSPRINGS_H
+#define PSPRINGS_H
+
+#include "core.h"
+#include "parallel.h"
+#include "particle.h"
+#include <unordered_map>
+#include <vector>
+
+namespace djinn {
+    /**
+     * Holds a whole mass-spring system (a cloth or soft body, say) as flat
+     * arrays instead of one generator object per spring end. Springs are
+     * stored in compressed sparse rows: the springs of row i all start at
+     * particle i, with their other end, stiffness, rest length and elastic
+     * limit side by side. updateForces() gathers the positions once, walks
+     * the rows in parallel and adds each spring's force to both of its ends,
+     * equal and opposite, through per-thread accumulators.
+     *
+     * Springs follow Hooke's law, f = -k (length - restLength) along the
+     * spring: they pull when stretched and push when compressed. Bungees
+     * only pull. Past its elastic limit a spring's stiffness drops to a
+     * quarter, as in ParticleAnchoredSpring.
+     */
+    class SpringNetwork {
+        friend class ImplicitSpringSolver;
+
+        protected:
+            // Every particle used by a spring, with its index
+            std::vector<Particle *> particles;
+            std::unordered_map<Particle *, unsigned> index;
+
+            // Spring s joins particles[from[s]] and particles[to[s]]; after build() the springs
+            //      are sorted by from, and those of row i are [firstSpring[i] .. firstSpring[i + 1])
+            std::vector<unsigned> from;
+            std::vector<unsigned> to;
+            std::vector<real> stiffness;
+            std::vector<real> restLengths;
+            std::vector<real> elasticLimits;
+            std::vector<char> bungee;
+            std::vector<unsigned> firstSpring;
+
+            // Springs from a particle to a fixed point
+            std::vector<unsigned> anchoredParticle;
+            std::vector<Vec3 *> anchors;
+            std::vector<real> anchoredStiffness;
+            std::vector<real> anchoredRestLengths;
+            std::vector<real> anchoredElasticLimits;
+
+            // True when springs were added since the rows were last built
+            bool dirty;
+
+            // Positions gathered for the sweep, whether each particle is free to move (awake with
+            //      finite mass), and the summed force on each particle
+            std::vector<Vec3> positions;
+            std::vector<char> moving;
+            std::vector<Vec3> forces;
+            ForceAccumulator accumulator;
+
+            // Energy stored in the springs at the last updateForces()
+            real potentialEnergy;
+
+            // Index of the particle, adding it if it is new
+            unsigned indexOf(Particle *particle);
+
+            // Sorts the springs into rows
+            void build();
+
+        public:
+            SpringNetwork() : dirty(false), potentialEnergy(0) {}
+
+            // Adds a spring between two particles
+            void add(Particle *a, Particle *b, real springConstant, real restLength, real elasticLimit = REAL_MAX);
+
+            // Adds a bungee between two particles, which only pulls when stretched past its rest length
+            void addBungee(Particle *a, Particle *b, real springConstant, real restLength);
+
+            // Adds a spring from a particle to a fixed point (the anchor is not copied, so it can be moved)
+            void addAnchored(Particle *particle, Vec3 *anchor, real springConstant, real restLength,
+                             real elasticLimit = REAL_MAX);
+
+            void clear();
+
+            // Number of springs between particles, and of anchored springs
+            unsigned size() const { return static_cast<unsigned>(to.size()); }
+            unsigned anchoredSize() const { return static_cast<unsigned>(anchors.size()); }
+
+            std::vector<Particle *> &getParticles() { return particles; }
+
+            // One of the two particles (end 0 or 1) of a spring between particles
+            Particle *getParticle(unsigned spring, unsigned end) const {
+                return particles[end ? to[spring] : from[spring]];
+            }
+
+            /**
+             * Adds the force of every spring to the particles at both of its
+             * ends. Springs with neither end moving are skipped, so a resting
+             * (sleeping) part of the network costs nothing, while a sleeping
+             * particle pulled by a moving neighbour gets the force and wakes.
+             * The sweep is split across threads by row, and the per-thread
+             * forces are summed in thread order, so the result is the same on
+             * every run for a given thread count.
+             */
+            void updateForces(real duration);
+
+            // Energy stored in the springs evaluated by the last updateForces()
+            real getPotentialEnergy() const { return potentialEnergy; }
+    }; // class SpringNetwork
+} // namespace djinn
+
+#endif // PSPRINGS_H
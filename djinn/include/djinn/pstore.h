@@ -0,0 +1,163 @@
+/**
+ * @file pstore.h
+ * @brief Header file for the structure-of-arrays particle store
+ * @author Catyre
+ */
+
+#ifndef PSTORE_H
+#define PSTORE_H
+
+#include "core.h"
+#include "particle.h"
+#include <string>
+#include <vector>
+
+namespace djinn {
+    /**
+     * Holds the state of many particles as a structure of arrays. Each
+     * quantity lives in its own contiguous array so loops that only need,
+     * say, positions and forces stream exactly that memory and can be
+     * vectorized. Cold data (names, potentials) is kept apart from the hot
+     * arrays.
+     *
+     * Particles are addressed by index (their slot). A store can hold
+     * standalone particle state (add()), or be bound to a list of Particle
+     * objects (bind()): each bound particle's state then lives in its slot,
+     * and the particle reads and writes it there, so the arrays are the
+     * only copy and nothing is gathered or scattered between passes.
+     */
+    class ParticleStore {
+        protected:
+            // Hot data, touched by every force and integration pass
+            std::vector<Vec3> positions;
+            std::vector<Vec3> velocities;
+            std::vector<Vec3> accelerations;
+            std::vector<Vec3> netForces;
+            std::vector<real> inverseMasses;
+            std::vector<real> dampings;
+
+            // Cold data, only kept for particles created with add()
+            std::vector<std::string> names;
+            std::vector<real> netPotentials;
+
+            // The particle bound to each slot, or null for slots created with add()
+            std::vector<Particle *> owners;
+
+            // Slots [0, activeCount) are the ones integrate() and the integrators step
+            unsigned activeCount;
+
+            // Exchanges two slots, keeping their particles pointed at them
+            void swapSlots(unsigned a, unsigned b);
+
+            // Removes a slot, moving the last one into its place
+            void removeSlot(unsigned index);
+
+        public:
+            ParticleStore() : activeCount(0) {}
+
+            // Two stores can't hold the same particles
+            ParticleStore(const ParticleStore &) = delete;
+            ParticleStore &operator=(const ParticleStore &) = delete;
+
+            // Hands every bound particle its state back
+            ~ParticleStore();
+
+            // Adds a particle to the store and returns its index
+            unsigned add(const Particle &particle);
+
+            unsigned add(const Vec3 &pos, const Vec3 &vel, const Vec3 &acc,
+                         const real damping, const real inverseMass,
+                         const std::string &name = "");
+
+            // Number of particles in the store
+            unsigned size() const { return static_cast<unsigned>(positions.size()); }
+
+            // Sets the number of particles, zero-initializing any new entries (and releasing bound ones cut off)
+            void resize(unsigned count);
+
+            // Releases every bound particle and empties the store
+            void clear();
+
+            /**
+             * Makes the store hold exactly the given particles. Particles new
+             * to it move their state into a slot of their own (leaving any
+             * other store), and particles it holds that are not in the list
+             * get their state back; slots created with add() are dropped.
+             * Slots are not in list order. When the store already holds
+             * exactly these particles this is one check per particle, so it
+             * can be called every frame.
+             */
+            void bind(const std::vector<Particle*> &particles);
+
+            // Moves a bound particle's state back into it and frees its slot
+            void release(Particle *particle);
+
+            // The particle bound to a slot, or null
+            Particle *getOwner(unsigned index) const { return owners[index]; }
+
+            /**
+             * Reorders the slots so that those whose particle passes
+             * moving(particle) come first, and makes them the active ones.
+             * Slots created with add() always count as moving.
+             */
+            template <typename Predicate>
+            void activate(Predicate moving);
+
+            // Makes every slot active (as it is after any slot is added or removed)
+            void activateAll() { activeCount = size(); }
+
+            // Number of active slots, which are slots [0, getActiveCount())
+            unsigned getActiveCount() const { return activeCount; }
+
+            // Builds a standalone Particle from the state at the given index
+            Particle getParticle(unsigned index) const;
+
+            // Clears every net force accumulator
+            void clearForces();
+
+            /**
+             * Integrates every active particle with finite mass forward in
+             * time, with the same semantics as Particle::integrate, then
+             * clears their forces and accelerations.
+             */
+            void integrate(real duration);
+
+            // Array access for kernels that run directly over the store
+            Vec3 *getPositions() { return positions.data(); }
+            const Vec3 *getPositions() const { return positions.data(); }
+
+            Vec3 *getVelocities() { return velocities.data(); }
+            const Vec3 *getVelocities() const { return velocities.data(); }
+
+            Vec3 *getAccelerations() { return accelerations.data(); }
+            const Vec3 *getAccelerations() const { return accelerations.data(); }
+
+            Vec3 *getNetForces() { return netForces.data(); }
+            const Vec3 *getNetForces() const { return netForces.data(); }
+
+            real *getInverseMasses() { return inverseMasses.data(); }
+            const real *getInverseMasses() const { return inverseMasses.data(); }
+
+            real *getDampings() { return dampings.data(); }
+            const real *getDampings() const { return dampings.data(); }
+
+            std::string getName(unsigned index) const { return names[index]; }
+    }; // class ParticleStore
+
+    template <typename Predicate>
+    void ParticleStore::activate(Predicate moving) {
+        // Slots that are already in place aren't touched, so a steady scene reorders nothing
+        unsigned next = 0;
+        for (unsigned i = 0; i < size(); i++) {
+            if (owners[i] && !moving(owners[i]))
+                continue;
+
+            if (i != next)
+                swapSlots(i, next);
+            next++;
+        }
+        activeCount = next;
+    }
+} // namespace djinn
+
+#endif // PSTORE_H
@@ -19,20 +19,32 @@
 #ifndef DJINN_PWORLD_H
 #define DJINN_PWORLD_H
 
+#include "collider.h"
+#include "implicit.h"
+#include "integrator.h"
 #include "pfgen.h"
 #include "plinks.h"
+#include "psprings.h"
+#include "pstore.h"
+#include "rodsolver.h"
+#include "xpbd.h"
+#include <unordered_map>
 
 namespace djinn {
 
     /**
      * Keeps track of a set of particles, and provides the means to
-     * update them all.
+     * update them all. Force update, integration and the contact
+     * generators that support it are split across the engine-wide
+     * job system (see setThreadCount()); contact resolution is serial.
      */
     class ParticleWorld
     {
     public:
         typedef std::vector<Particle*> Particles;
         typedef std::vector<ParticleContactGenerator*> ContactGenerators;
+        typedef std::vector<StaticCollider*> StaticColliders;
+        typedef std::vector<SpringNetwork*> SpringNetworks;
 
     protected:
         /**
@@ -40,6 +52,38 @@ namespace djinn {
          */
         Particles particles;
 
+        /**
+         * Structure-of-arrays home of the particles' hot state. The
+         * particles are bound to it at the start of each frame and stay
+         * bound, so the integration phase streams contiguous arrays
+         * instead of chasing particle pointers, and nothing is copied in
+         * or out.
+         */
+        ParticleStore store;
+
+        /**
+         * Steps the particles in place of ParticleStore::integrate, if set.
+         */
+        Integrator *integrator;
+
+        /**
+         * True if a two-phase integrator left the forces at the particles'
+         * current positions in their accumulators at the end of the last
+         * step, so the next step doesn't evaluate them again.
+         */
+        bool forcesCarried;
+
+        /**
+         * Applies the force generators and spring networks.
+         */
+        void applyForces(real duration);
+
+        /**
+         * Finishes a two-phase integrator's step: evaluates the forces at
+         * the new positions and hands them to the integrator.
+         */
+        void finishIntegration(real duration);
+
         /**
          * True if the world should calculate the number of iterations
          * to give the contact resolver at each frame.
@@ -51,35 +95,171 @@ namespace djinn {
          */
         ParticleForceRegistry registry;
 
+        /**
+         * Holds the spring networks, which apply their forces after
+         * the force generators.
+         */
+        SpringNetworks springNetworks;
+
         /**
          * Holds the resolver for contacts.
          */
         ParticleContactResolver resolver;
 
+        /**
+         * True if each frame's contacts should be warm started with the
+         * impulses of the same pairs last frame.
+         */
+        bool warmStarting;
+
+        /**
+         * Holds last frame's contact impulses, keyed by particle pair.
+         */
+        ContactCache contactCache;
+
+        /**
+         * Moves the particles of the links it holds in place of the
+         * integrator, if set.
+         */
+        XPBDSolver *constraintSolver;
+
+        /**
+         * Integrates the particles of its spring network implicitly in
+         * place of the integrator, if set.
+         */
+        ImplicitSpringSolver *implicitSolver;
+
+        /**
+         * Projects the particles of the rods and cables it holds onto
+         * their links after integration, if set.
+         */
+        RodChainSolver *rodSolver;
+
+        /**
+         * The contact generators run this frame: the registered ones,
+         * then the rod solver's leftover links.
+         */
+        ContactGenerators activeGenerators;
+
+        /**
+         * True if particles should be swept against the static
+         * colliders after integration.
+         */
+        bool continuousCollision;
+
+        /**
+         * Restitution of swept hits, and the radius the particles are
+         * swept with.
+         */
+        real sweepRestitution;
+        real sweepRadius;
+
+        /**
+         * Holds the static colliders particles are swept against.
+         */
+        StaticColliders staticColliders;
+
+        /**
+         * Position, velocity and acceleration (stored plus net force over
+         * mass) of each integrated particle at the start of the step (only
+         * kept with continuous collision).
+         */
+        std::vector<Vec3> startPositions;
+        std::vector<Vec3> startVelocities;
+        std::vector<Vec3> startAccelerations;
+
+        /**
+         * Sweeps each active particle in the store along its path for this step.
+         * A particle that hits a collider is moved back to the point of
+         * impact, has its velocity reflected with the sweep restitution,
+         * and is moved over the rest of the step from there by the
+         * integrator's restep() (with the acceleration it was given).
+         */
+        void sweepStaticColliders(real duration);
+
+        /**
+         * True if resting islands of particles should be put to sleep.
+         */
+        bool sleeping;
+
+        /**
+         * Average kinetic energy per particle below which an island
+         * counts as resting, and the number of consecutive resting
+         * frames after which it goes to sleep.
+         */
+        real sleepEnergy;
+        unsigned sleepFrames;
+
+        /**
+         * Consecutive resting frames of each particle (keyed by the
+         * particle, so reordering the particle list doesn't mix them up),
+         * and the union-find forest used to group the particles into
+         * islands.
+         */
+        std::unordered_map<Particle*, unsigned> restFrames;
+        std::vector<unsigned> islandParent;
+        std::unordered_map<Particle*, unsigned> particleIndex;
+
+        /**
+         * Drops contacts whose particles are all asleep (or immovable)
+         * and wakes any sleeping particle touched by an awake one.
+         * Returns the number of contacts left.
+         */
+        unsigned filterSleepingContacts(unsigned numContacts);
+
+        /**
+         * Groups the particles into islands through this frame's
+         * contacts and the world's links, and puts to sleep every
+         * island that has been resting for long enough.
+         */
+        void updateSleeping(unsigned numContacts);
+
+        /**
+         * Returns the representative of the island holding particle i.
+         */
+        unsigned findIsland(unsigned i);
+
         /**
          * Contact generators.
          */
         ContactGenerators contactGenerators;
 
         /**
-         * Holds the list of contacts.
+         * Holds the list of contacts, joined from the generators' chunks
+         * in generator order.
+         */
+        std::vector<ParticleContact> contacts;
+
+        /**
+         * One chunk of contacts per generator. A generator that fills
+         * its chunk has the chunk doubled and is run again, so no
+         * contacts are ever dropped.
          */
-        ParticleContact *contacts;
+        std::vector<std::vector<ParticleContact>> generatorContacts;
+        std::vector<unsigned> generatorUsed;
 
         /**
-         * Holds the maximum number of contacts allowed (i.e. the
-         * size of the contacts array).
+         * Holds the number of contacts each generator's chunk starts
+         * with.
          */
         unsigned maxContacts;
 
+        /**
+         * Number of times a generator has filled its chunk, since the
+         * world was created and in the last frame.
+         */
+        unsigned contactOverflows;
+        unsigned lastContactOverflows;
+
     public:
 
         /**
-         * Creates a new particle simulator that can handle up to the
-         * given number of contacts per frame. You can also optionally
-         * give a number of contact-resolution iterations to use. If you
-         * don't give a number of iterations, then twice the number of
-         * contacts will be used.
+         * Creates a new particle simulator whose contact generators
+         * start with room for the given number of contacts each (the
+         * room grows as needed). You can also optionally give a number
+         * of contact-resolution iterations to use. If you don't give a
+         * number of iterations, then twice the number of contacts will
+         * be used.
          */
         ParticleWorld(unsigned maxContacts, unsigned iterations=0);
 
@@ -90,7 +270,8 @@ namespace djinn {
 
         /**
          * Calls each of the registered contact generators to report
-         * their contacts. Returns the number of generated contacts.
+         * their contacts, in parallel on the job system, and joins them
+         * in generator order. Returns the number of generated contacts.
          */
         unsigned generateContacts();
 
@@ -107,7 +288,8 @@ namespace djinn {
 
         /**
          * Initializes the world for a simulation frame. This clears
-         * the force accumulators for particles in the world. After
+         * the force accumulators for particles in the world (unless a
+         * two-phase integrator left this frame's forces in them). After
          * calling this, the particles can have their forces for this
          * frame added.
          */
@@ -127,6 +309,123 @@ namespace djinn {
          * Returns the force registry.
          */
         ParticleForceRegistry& getForceRegistry();
+
+        /**
+         * Returns the list of spring networks.
+         */
+        SpringNetworks& getSpringNetworks();
+
+        /**
+         * Returns the number of times a contact generator has run out
+         * of room (and had it doubled) since the world was created,
+         * and in the last frame.
+         */
+        unsigned getContactOverflows() const;
+        unsigned getLastContactOverflows() const;
+
+        /**
+         * Returns the combined room of all the generators' contact
+         * chunks.
+         */
+        unsigned getContactCapacity() const;
+
+        /**
+         * Returns the contact resolver, e.g. to switch it to the
+         * priority queue with useContactHeap().
+         */
+        ParticleContactResolver& getContactResolver();
+
+        /**
+         * Starts each frame's contacts with the given fraction of the
+         * impulse their particle pair needed last frame, and gives the
+         * resolver tolerances so it stops once the contacts are settled
+         * rather than always using the full iteration budget.
+         */
+        void useWarmStarting(real factor = 0.8, real velocityTolerance = 0.01,
+                             real penetrationTolerance = 0.001);
+
+        /**
+         * Splits the particles into islands (connected through contacts,
+         * links, and the springs of the force registry and spring
+         * networks) every frame. An island whose average kinetic energy
+         * per particle stays below energyThreshold for the given number
+         * of frames goes to sleep: its particles get no force updates,
+         * integration or contacts among themselves until an external
+         * force, a contact with an awake particle, or the pull of a
+         * moving particle through a spring or pair potential wakes them.
+         */
+        void enableSleeping(real energyThreshold, unsigned frames = 30);
+
+        /**
+         * Wakes every particle and stops putting islands to sleep.
+         */
+        void disableSleeping();
+
+        /**
+         * Sweeps every integrated particle (as a sphere of the given
+         * radius) against the static colliders each step, so fast
+         * particles stop at the first collider on their path instead of
+         * tunnelling through it. Particles moved by the constraint
+         * solver are not swept.
+         */
+        void enableContinuousCollision(real restitution = 0.5, real radius = 0);
+
+        /**
+         * Stops sweeping particles against the static colliders.
+         */
+        void disableContinuousCollision();
+
+        /**
+         * Returns the list of static colliders.
+         */
+        StaticColliders& getStaticColliders();
+
+        /**
+         * Steps the particles the world integrates with the given
+         * integrator instead of the default ParticleStore::integrate.
+         * With a two-phase integrator (e.g. VelocityVerlet) the forces
+         * are evaluated at the new positions at the end of each step
+         * and carried into the next one, so a step still costs one
+         * evaluation; with sleeping enabled they are evaluated at both
+         * ends instead, since particles woken in between would miss
+         * theirs. Pass null to go back to the default. The integrator
+         * is not owned by the world.
+         */
+        void setIntegrator(Integrator *integrator);
+
+        /**
+         * Hands the particles of the solver's links over to it: each
+         * frame the world integrates every other particle and the
+         * solver steps these. Pass null to go back to integrating
+         * every particle. The solver is not owned by the world.
+         */
+        void setConstraintSolver(XPBDSolver *solver);
+
+        /**
+         * Hands the particles of the solver's spring network over to it:
+         * each frame the world integrates every other particle and the
+         * solver steps these with backward Euler, so stiff springs can
+         * take long steps. Pass null to go back to integrating every
+         * particle. The solver is not owned by the world, and its
+         * network should not also be in getSpringNetworks().
+         */
+        void setImplicitSolver(ImplicitSpringSolver *solver);
+
+        /**
+         * Solves the rods and cables of the given solver directly after
+         * each integration step; any of its links that can't be solved
+         * directly are passed on to the contact resolver. Pass null to
+         * stop. The solver is not owned by the world, and its links
+         * should not also be registered as contact generators.
+         */
+        void setRodSolver(RodChainSolver *solver);
+
+        /**
+         * Returns the structure-of-arrays store holding the state of the
+         * world's particles. Its active slots are the particles integrated
+         * by the last step.
+         */
+        ParticleStore& getStore();
     };
 
     /**
@@ -0,0 +1,177 @@
+/**
+ * @file rodsolver.h
+ * @brief Header file for the direct (tree-structured) solver for chains of rods and cables
+ * @author Catyre
+ */
+
+#ifndef RODSOLVER_H
+#define RODSOLVER_H
+
+#include "core.h"
+#include "plinks.h"
+#include <unordered_map>
+#include <vector>
+
+namespace djinn {
+    /**
+     * Solves assemblies of rods and taut cables exactly, in time linear in
+     * their size, instead of iterating contact by contact. Following
+     * Baraff's "Linear-Time Dynamics using Lagrange Multipliers", the
+     * particles and links are the nodes of a graph with an edge wherever a
+     * link touches a particle. While the assembly has no loops this graph
+     * is a tree, and the system
+     *
+     *     [ M  -J^T ] [ dx     ]   [ 0 ]
+     *     [-J   0   ] [ lambda ] = [ r ]
+     *
+     * is factored in the order children before parents without any fill-in.
+     * Each frame the solver first projects the positions back onto the
+     * links (Newton steps on the link lengths) and then removes the
+     * velocity along every link.
+     *
+     * Each component is rooted at a link to an immovable particle if it has
+     * one. Links that would close a loop, or tie a component to a second
+     * immovable particle, cannot be part of the tree; they are left to the
+     * iterative contact resolver through addContact(). Cables only take part
+     * while they are taut, and only in the velocity pass while stretching.
+     */
+    class RodChainSolver : public ParticleContactGenerator {
+        protected:
+            // Symmetric 3x3 block of the factorization
+            struct Block {
+                real xx, xy, xz, yy, yz, zz;
+            };
+
+            struct Link {
+                ParticleLink *link;
+                bool cable;
+            };
+
+            // A link that takes part in the current pass
+            struct Constraint {
+                unsigned link;
+
+                // Particle nodes at either end, NONE for an immovable particle
+                unsigned a, b;
+
+                // Unit vector from b to a, and how far the link is from its length
+                Vec3 normal;
+                real error;
+            };
+
+            static constexpr unsigned NONE = ~0u;
+
+            static Vec3 multiply(const Block &m, const Vec3 &v);
+            static Block inverse(const Block &m);
+
+            std::vector<Link> links;
+
+            // Movable particles of the current pass; node i < particles.size() is particle i,
+            //      node particles.size() + c is constraint c
+            std::vector<Particle *> particles;
+            std::unordered_map<Particle *, unsigned> particleIndex;
+            std::vector<Constraint> constraints;
+
+            // The tree: parent of each node, and the Jacobian entry of the edge to it
+            std::vector<unsigned> parent;
+            std::vector<Vec3> edge;
+
+            // Nodes in breadth-first order, so parents come before their children
+            std::vector<unsigned> order;
+
+            // Constraints of each particle, CSR style
+            std::vector<unsigned> firstConstraint;
+            std::vector<unsigned> particleConstraints;
+
+            // Factorization: inverse diagonal blocks of particle nodes, diagonals of constraint nodes
+            std::vector<Block> particleInverse;
+            std::vector<real> constraintDiagonal;
+
+            // Right hand side and solution
+            std::vector<Vec3> particleValues;
+            std::vector<real> constraintValues;
+
+            // Links left out of the tree being solved, and those left to the iterative
+            //      resolver by the last project(): everything left out of its first pass (which
+            //      sees every taut link), plus the links its Newton steps couldn't bring within
+            //      the tolerance
+            std::vector<const ParticleLink *> treeLeftover;
+            std::vector<const ParticleLink *> leftover;
+
+            // Whether each constraint of the current pass is in the tree
+            std::vector<char> solved;
+
+            // Positions before the current Newton step
+            std::vector<Vec3> startPositions;
+
+            // Most Newton steps per frame; a settled assembly needs one or two, but a
+            //      chain whipping through large angles each frame can need a few dozen
+            unsigned positionIterations;
+
+            // Largest length error (in metres) the position projection stops at
+            real tolerance;
+
+            // Index of the particle's node, or NONE if it cannot move
+            unsigned nodeOf(Particle *particle);
+
+            // Gathers the links active in this pass (velocity pass if velocities is true)
+            void gatherConstraints(bool velocities);
+
+            // Builds the spanning forest and marks the links left out of it
+            void buildTree();
+
+            void factor();
+
+            // Solves for the particle changes given constraintValues as the right hand side
+            void solve();
+
+            // How far a link is from its length (cables only when too long)
+            static real linkError(const Link &link);
+
+            // Largest length error of the constraints in the tree at the current positions,
+            //      or the sum of their squares
+            real treeError(bool squared) const;
+
+        public:
+            RodChainSolver(unsigned positionIterations = 32, real tolerance = 1e-9)
+                : positionIterations(positionIterations), tolerance(tolerance) {}
+
+            void add(ParticleRod *rod);
+            void add(ParticleCable *cable);
+
+            void remove(ParticleLink *link);
+
+            void clear();
+
+            void setPositionIterations(unsigned iterations) { positionIterations = iterations; }
+
+            void setTolerance(real tolerance) { this->tolerance = tolerance; }
+
+            unsigned size() const { return static_cast<unsigned>(links.size()); }
+
+            // One of the two particles (end 0 or 1) of a link
+            Particle *getParticle(unsigned link, unsigned end) const { return links[link].link->particles[end]; }
+
+            /**
+             * Projects the positions and then the velocities of the linked
+             * particles onto their links. The position projection stops once
+             * every link is within the tolerance, after the given number of
+             * Newton steps, or when a step (even shortened) no longer helps;
+             * links still outside the tolerance then are also passed on to
+             * the contact resolver. Sleeping particles are treated as
+             * immovable.
+             */
+            void project();
+
+            // Number of links left to the iterative resolver by the last project()
+            unsigned getLeftoverCount() const { return static_cast<unsigned>(leftover.size()); }
+
+            /**
+             * Writes the contacts of the links the last project() could not
+             * solve directly, up to limit.
+             */
+            virtual unsigned addContact(ParticleContact *contact, unsigned limit) const;
+    }; // class RodChainSolver
+} // namespace djinn
+
+#endif // RODSOLVER_H
@@ -0,0 +1,296 @@
+/**
+ * @file simd.h
+ * @brief SIMD kernels for four-lane (x, y, z, pad) vectors
+ * @author Catyre
+ */
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "precision.h"
+
+/*
+ * The instruction set is picked at build time from what the compiler has been
+ * told it may use (e.g. -march=native, see DJINN_NATIVE_ARCH in CMakeLists.txt):
+ *
+ *   double precision: AVX2 (4 doubles in one 256-bit register), SSE2 or NEON (2 x 128-bit)
+ *   single precision: SSE (4 floats in one 128-bit register) or NEON
+ *
+ * SSE2 is part of every x86-64 target, so a default x86-64 build uses it; AVX2
+ * needs DJINN_NATIVE_ARCH (or another -march that has it). Anything else, or
+ * defining DJINN_NO_SIMD, falls back to plain scalar code.
+ */
+#if !defined(DJINN_NO_SIMD)
+    #if defined(DOUBLE_PRECISION) && defined(__AVX2__)
+        #define DJINN_SIMD_AVX
+        #include <immintrin.h>
+    #elif defined(DOUBLE_PRECISION) && (defined(__SSE2__) || defined(_M_X64))
+        #define DJINN_SIMD_SSE2
+        #include <emmintrin.h>
+    #elif defined(SINGLE_PRECISION) && (defined(__SSE__) || defined(_M_X64))
+        #define DJINN_SIMD_SSE
+        #include <xmmintrin.h>
+    #elif defined(__ARM_NEON) && defined(__aarch64__)
+        #define DJINN_SIMD_NEON
+        #include <arm_neon.h>
+    #endif
+#endif
+
+namespace djinn {
+    namespace simd {
+        /*
+         * Every kernel works on pointers to four contiguous reals laid out as
+         * x, y, z, pad. The pad lane of the inputs must be finite (Vec3 keeps
+         * it at zero) and is left at zero in the outputs. Output pointers may
+         * alias inputs.
+         */
+
+        // Name of the instruction set the kernels were compiled for
+        inline const char *isa() {
+#if defined(DJINN_SIMD_AVX)
+            return "AVX2";
+#elif defined(DJINN_SIMD_SSE2)
+            return "SSE2";
+#elif defined(DJINN_SIMD_SSE)
+            return "SSE";
+#elif defined(DJINN_SIMD_NEON)
+            return "NEON";
+#else
+            return "scalar";
+#endif
+        }
+
+#if defined(DJINN_SIMD_AVX)
+        inline __m256d load(const real *p) { return _mm256_loadu_pd(p); }
+        inline void store(real *p, __m256d v) { _mm256_storeu_pd(p, v); }
+
+        inline void add(real *out, const real *a, const real *b) { store(out, _mm256_add_pd(load(a), load(b))); }
+
+        inline void sub(real *out, const real *a, const real *b) { store(out, _mm256_sub_pd(load(a), load(b))); }
+
+        inline void mul(real *out, const real *a, const real *b) { store(out, _mm256_mul_pd(load(a), load(b))); }
+
+        inline void scale(real *out, const real *a, real s) { store(out, _mm256_mul_pd(load(a), _mm256_set1_pd(s))); }
+
+        // out += v * s
+        inline void addScaled(real *out, const real *v, real s) {
+    #if defined(__FMA__)
+            store(out, _mm256_fmadd_pd(load(v), _mm256_set1_pd(s), load(out)));
+    #else
+            store(out, _mm256_add_pd(load(out), _mm256_mul_pd(load(v), _mm256_set1_pd(s))));
+    #endif
+        }
+
+        inline real dot(const real *a, const real *b) {
+            __m256d m = _mm256_mul_pd(load(a), load(b));
+            __m128d xy = _mm256_castpd256_pd128(m);
+            __m128d zw = _mm256_extractf128_pd(m, 1);
+            __m128d sum = _mm_add_sd(_mm_add_sd(xy, _mm_unpackhi_pd(xy, xy)), zw);
+            return _mm_cvtsd_f64(sum);
+        }
+
+        inline void cross(real *out, const real *a, const real *b) {
+            __m256d va = load(a);
+            __m256d vb = load(b);
+            // (y, z, x, pad) and (z, x, y, pad) rotations
+            __m256d aYZX = _mm256_permute4x64_pd(va, _MM_SHUFFLE(3, 0, 2, 1));
+            __m256d aZXY = _mm256_permute4x64_pd(va, _MM_SHUFFLE(3, 1, 0, 2));
+            __m256d bYZX = _mm256_permute4x64_pd(vb, _MM_SHUFFLE(3, 0, 2, 1));
+            __m256d bZXY = _mm256_permute4x64_pd(vb, _MM_SHUFFLE(3, 1, 0, 2));
+            store(out, _mm256_sub_pd(_mm256_mul_pd(aYZX, bZXY), _mm256_mul_pd(aZXY, bYZX)));
+        }
+#elif defined(DJINN_SIMD_SSE2)
+        // Two 128-bit registers per vector: (x, y) and (z, pad)
+        inline void add(real *out, const real *a, const real *b) {
+            _mm_storeu_pd(out, _mm_add_pd(_mm_loadu_pd(a), _mm_loadu_pd(b)));
+            _mm_storeu_pd(out + 2, _mm_add_pd(_mm_loadu_pd(a + 2), _mm_loadu_pd(b + 2)));
+        }
+
+        inline void sub(real *out, const real *a, const real *b) {
+            _mm_storeu_pd(out, _mm_sub_pd(_mm_loadu_pd(a), _mm_loadu_pd(b)));
+            _mm_storeu_pd(out + 2, _mm_sub_pd(_mm_loadu_pd(a + 2), _mm_loadu_pd(b + 2)));
+        }
+
+        inline void mul(real *out, const real *a, const real *b) {
+            _mm_storeu_pd(out, _mm_mul_pd(_mm_loadu_pd(a), _mm_loadu_pd(b)));
+            _mm_storeu_pd(out + 2, _mm_mul_pd(_mm_loadu_pd(a + 2), _mm_loadu_pd(b + 2)));
+        }
+
+        inline void scale(real *out, const real *a, real s) {
+            __m128d vs = _mm_set1_pd(s);
+            _mm_storeu_pd(out, _mm_mul_pd(_mm_loadu_pd(a), vs));
+            _mm_storeu_pd(out + 2, _mm_mul_pd(_mm_loadu_pd(a + 2), vs));
+        }
+
+        // out += v * s
+        inline void addScaled(real *out, const real *v, real s) {
+            __m128d vs = _mm_set1_pd(s);
+            _mm_storeu_pd(out, _mm_add_pd(_mm_loadu_pd(out), _mm_mul_pd(_mm_loadu_pd(v), vs)));
+            _mm_storeu_pd(out + 2, _mm_add_pd(_mm_loadu_pd(out + 2), _mm_mul_pd(_mm_loadu_pd(v + 2), vs)));
+        }
+
+        inline real dot(const real *a, const real *b) {
+            __m128d xy = _mm_mul_pd(_mm_loadu_pd(a), _mm_loadu_pd(b));
+            __m128d z = _mm_mul_sd(_mm_load_sd(a + 2), _mm_load_sd(b + 2));
+            return _mm_cvtsd_f64(_mm_add_sd(_mm_add_sd(xy, _mm_unpackhi_pd(xy, xy)), z));
+        }
+
+        // Lane shuffles are awkward across two registers, so the cross product stays scalar
+        inline void cross(real *out, const real *a, const real *b) {
+            real x = a[1] * b[2] - a[2] * b[1];
+            real y = a[2] * b[0] - a[0] * b[2];
+            real z = a[0] * b[1] - a[1] * b[0];
+            out[0] = x;
+            out[1] = y;
+            out[2] = z;
+        }
+#elif defined(DJINN_SIMD_SSE)
+        inline __m128 load(const real *p) { return _mm_loadu_ps(p); }
+        inline void store(real *p, __m128 v) { _mm_storeu_ps(p, v); }
+
+        inline void add(real *out, const real *a, const real *b) { store(out, _mm_add_ps(load(a), load(b))); }
+
+        inline void sub(real *out, const real *a, const real *b) { store(out, _mm_sub_ps(load(a), load(b))); }
+
+        inline void mul(real *out, const real *a, const real *b) { store(out, _mm_mul_ps(load(a), load(b))); }
+
+        inline void scale(real *out, const real *a, real s) { store(out, _mm_mul_ps(load(a), _mm_set1_ps(s))); }
+
+        // out += v * s
+        inline void addScaled(real *out, const real *v, real s) {
+            store(out, _mm_add_ps(load(out), _mm_mul_ps(load(v), _mm_set1_ps(s))));
+        }
+
+        inline real dot(const real *a, const real *b) {
+            __m128 m = _mm_mul_ps(load(a), load(b));
+            __m128 y = _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1));
+            __m128 z = _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2));
+            return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(m, y), z));
+        }
+
+        inline void cross(real *out, const real *a, const real *b) {
+            __m128 va = load(a);
+            __m128 vb = load(b);
+            // (y, z, x, pad) and (z, x, y, pad) rotations
+            __m128 aYZX = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 0, 2, 1));
+            __m128 aZXY = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 1, 0, 2));
+            __m128 bYZX = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 0, 2, 1));
+            __m128 bZXY = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 1, 0, 2));
+            store(out, _mm_sub_ps(_mm_mul_ps(aYZX, bZXY), _mm_mul_ps(aZXY, bYZX)));
+        }
+#elif defined(DJINN_SIMD_NEON) && defined(DOUBLE_PRECISION)
+        // Two 128-bit registers per vector: (x, y) and (z, pad)
+        inline void add(real *out, const real *a, const real *b) {
+            vst1q_f64(out, vaddq_f64(vld1q_f64(a), vld1q_f64(b)));
+            vst1q_f64(out + 2, vaddq_f64(vld1q_f64(a + 2), vld1q_f64(b + 2)));
+        }
+
+        inline void sub(real *out, const real *a, const real *b) {
+            vst1q_f64(out, vsubq_f64(vld1q_f64(a), vld1q_f64(b)));
+            vst1q_f64(out + 2, vsubq_f64(vld1q_f64(a + 2), vld1q_f64(b + 2)));
+        }
+
+        inline void mul(real *out, const real *a, const real *b) {
+            vst1q_f64(out, vmulq_f64(vld1q_f64(a), vld1q_f64(b)));
+            vst1q_f64(out + 2, vmulq_f64(vld1q_f64(a + 2), vld1q_f64(b + 2)));
+        }
+
+        inline void scale(real *out, const real *a, real s) {
+            vst1q_f64(out, vmulq_n_f64(vld1q_f64(a), s));
+            vst1q_f64(out + 2, vmulq_n_f64(vld1q_f64(a + 2), s));
+        }
+
+        // out += v * s
+        inline void addScaled(real *out, const real *v, real s) {
+            vst1q_f64(out, vfmaq_n_f64(vld1q_f64(out), vld1q_f64(v), s));
+            vst1q_f64(out + 2, vfmaq_n_f64(vld1q_f64(out + 2), vld1q_f64(v + 2), s));
+        }
+
+        inline real dot(const real *a, const real *b) {
+            return vaddvq_f64(vmulq_f64(vld1q_f64(a), vld1q_f64(b))) + a[2] * b[2];
+        }
+
+        // Lane shuffles are awkward across two registers, so the cross product stays scalar
+        inline void cross(real *out, const real *a, const real *b) {
+            real x = a[1] * b[2] - a[2] * b[1];
+            real y = a[2] * b[0] - a[0] * b[2];
+            real z = a[0] * b[1] - a[1] * b[0];
+            out[0] = x;
+            out[1] = y;
+            out[2] = z;
+        }
+#elif defined(DJINN_SIMD_NEON)
+        inline void add(real *out, const real *a, const real *b) { vst1q_f32(out, vaddq_f32(vld1q_f32(a), vld1q_f32(b))); }
+
+        inline void sub(real *out, const real *a, const real *b) { vst1q_f32(out, vsubq_f32(vld1q_f32(a), vld1q_f32(b))); }
+
+        inline void mul(real *out, const real *a, const real *b) { vst1q_f32(out, vmulq_f32(vld1q_f32(a), vld1q_f32(b))); }
+
+        inline void scale(real *out, const real *a, real s) { vst1q_f32(out, vmulq_n_f32(vld1q_f32(a), s)); }
+
+        // out += v * s
+        inline void addScaled(real *out, const real *v, real s) {
+            vst1q_f32(out, vfmaq_n_f32(vld1q_f32(out), vld1q_f32(v), s));
+        }
+
+        inline real dot(const real *a, const real *b) {
+            float32x4_t m = vmulq_f32(vld1q_f32(a), vld1q_f32(b));
+            return vaddvq_f32(vsetq_lane_f32(0.0f, m, 3));
+        }
+
+        // Lane shuffles are awkward on NEON, so the cross product stays scalar
+        inline void cross(real *out, const real *a, const real *b) {
+            real x = a[1] * b[2] - a[2] * b[1];
+            real y = a[2] * b[0] - a[0] * b[2];
+            real z = a[0] * b[1] - a[1] * b[0];
+            out[0] = x;
+            out[1] = y;
+            out[2] = z;
+        }
+#else
+        inline void add(real *out, const real *a, const real *b) {
+            out[0] = a[0] + b[0];
+            out[1] = a[1] + b[1];
+            out[2] = a[2] + b[2];
+        }
+
+        inline void sub(real *out, const real *a, const real *b) {
+            out[0] = a[0] - b[0];
+            out[1] = a[1] - b[1];
+            out[2] = a[2] - b[2];
+        }
+
+        inline void mul(real *out, const real *a, const real *b) {
+            out[0] = a[0] * b[0];
+            out[1] = a[1] * b[1];
+            out[2] = a[2] * b[2];
+        }
+
+        inline void scale(real *out, const real *a, real s) {
+            out[0] = a[0] * s;
+            out[1] = a[1] * s;
+            out[2] = a[2] * s;
+        }
+
+        // out += v * s
+        inline void addScaled(real *out, const real *v, real s) {
+            out[0] += v[0] * s;
+            out[1] += v[1] * s;
+            out[2] += v[2] * s;
+        }
+
+        inline real dot(const real *a, const real *b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+        inline void cross(real *out, const real *a, const real *b) {
+            real x = a[1] * b[2] - a[2] * b[1];
+            real y = a[2] * b[0] - a[0] * b[2];
+            real z = a[0] * b[1] - a[1] * b[0];
+            out[0] = x;
+            out[1] = y;
+            out[2] = z;
+        }
+#endif
+    } // namespace simd
+} // namespace djinn
+
+#endif // SIMD_H
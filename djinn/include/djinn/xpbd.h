@@ -0,0 +1,113 @@
+/**
+ * @file xpbd.h
+ * @brief Header file for the position-based (XPBD) solver for cables and rods
+ * @author Catyre
+ */
+
+#ifndef XPBD_H
+#define XPBD_H
+
+#include "core.h"
+#include "plinks.h"
+#include <unordered_map>
+#include <vector>
+
+namespace djinn {
+    /**
+     * Enforces cables and rods by moving the particles directly instead of
+     * generating contacts for the impulse resolver (extended position based
+     * dynamics). Each frame is split into substeps; every substep predicts
+     * the positions of the linked particles from their velocity and net
+     * force, projects each link back to its length, then takes the velocity
+     * from the corrected positions.
+     *
+     * A link's compliance is the inverse of its stiffness: 0 is perfectly
+     * rigid, larger values let it stretch under load like a spring. Links
+     * are graph colored once when the set changes, and the links of a color
+     * (which share no particle) are solved across the job system, so the
+     * cost per frame is fixed by the number of links, substeps and
+     * iterations rather than by how stretched the chain is.
+     *
+     * Links given to the solver should not also be registered as contact
+     * generators with the world.
+     */
+    class XPBDSolver {
+        protected:
+            struct Constraint {
+                const ParticleLink *link;
+
+                // Indices of the two particles in the solver's arrays
+                unsigned a, b;
+
+                real length;
+                real compliance;
+
+                // Cables only pull; rods also push
+                bool cable;
+
+                // Accumulated Lagrange multiplier of the current substep
+                real lambda;
+            };
+
+            std::vector<Constraint> constraints;
+
+            // Every particle touched by a link, with its index
+            std::vector<Particle *> particles;
+            std::unordered_map<const Particle *, unsigned> index;
+            std::vector<ParticleLink *> links;
+
+            // Working state of the particles during a step
+            std::vector<Vec3> positions;
+            std::vector<Vec3> previous;
+            std::vector<Vec3> velocities;
+            std::vector<Vec3> accelerations;
+            std::vector<real> inverseMasses;
+
+            // Constraint indices sorted by color; color k owns colorOrder[colorStart[k] .. colorStart[k + 1])
+            std::vector<unsigned> colorStart;
+            std::vector<unsigned> colorOrder;
+
+            unsigned substeps;
+            unsigned iterations;
+
+            // True when links were added or removed since the last step
+            bool dirty;
+
+            void add(ParticleLink *link, real compliance, bool cable);
+
+            // Rebuilds the particle list, the constraint indices and the coloring
+            void build();
+
+            // Projects one constraint, given its compliance scaled by 1 / h^2
+            void solve(Constraint &constraint, real alphaTilde);
+
+        public:
+            XPBDSolver(unsigned substeps = 8, unsigned iterations = 1);
+
+            // Adds a cable (or rod), with the given compliance in metres per newton
+            void add(ParticleCable *cable, real compliance = 0);
+            void add(ParticleRod *rod, real compliance = 0);
+
+            void remove(ParticleLink *link);
+
+            void clear();
+
+            void setSubsteps(unsigned substeps);
+            void setIterations(unsigned iterations);
+
+            // Returns true if the particle is moved by this solver (rebuilding the index if links changed)
+            bool owns(const Particle *particle);
+
+            const std::vector<ParticleLink *> &getLinks() const { return links; }
+
+            /**
+             * Advances every linked particle by the given duration, using its
+             * net force and acceleration like ParticleWorld::integrate (and
+             * clearing them afterwards). Particles with infinite mass, and
+             * sleeping particles, are held where they are.
+             */
+            void step(real duration);
+    }; // class XPBDSolver
+} // namespace djinn
+
+#endif // XPBD_H
@@ -0,0 +1,89 @@
+/**
+ * @file celllist.cpp
+ * @brief Define methods for the periodic cell list
+ * @author Catyre
+ */
+
+#include "djinn/celllist.h"
+#include <assert.h>
+#include <cmath>
+
+void djinn::CellList::setBox(const djinn::Vec3 &bounds, djinn::real cutoff) {
+    assert(cutoff > 0);
+    assert(bounds.x > 0 && bounds.y > 0 && bounds.z > 0);
+
+    this->bounds = bounds;
+    this->cutoff = cutoff;
+    cutoffSq = cutoff * cutoff;
+
+    // As many cells as fit along each axis while staying at least one cutoff wide
+    const djinn::real lengths[3] = {bounds.x, bounds.y, bounds.z};
+    for (int axis = 0; axis < 3; axis++) {
+        cells[axis] = std::max(1, static_cast<int>(std::floor(lengths[axis] / cutoff)));
+    }
+
+    cellSize = djinn::Vec3(bounds.x / cells[0], bounds.y / cells[1], bounds.z / cells[2]);
+    cellStart.assign(cellCount() + 1, 0);
+}
+
+unsigned djinn::CellList::cellIndex(const djinn::Vec3 &p) const {
+    int c[3] = {static_cast<int>(std::floor(p.x / cellSize.x)),
+                static_cast<int>(std::floor(p.y / cellSize.y)),
+                static_cast<int>(std::floor(p.z / cellSize.z))};
+
+    // Wrap positions that have drifted outside the box back into it
+    for (int axis = 0; axis < 3; axis++) {
+        c[axis] %= cells[axis];
+        if (c[axis] < 0)
+            c[axis] += cells[axis];
+    }
+
+    return static_cast<unsigned>((c[2] * cells[1] + c[1]) * cells[0] + c[0]);
+}
+
+unsigned djinn::CellList::neighbourCells(unsigned cell, unsigned *out) const {
+    int cx = cell % cells[0];
+    int cy = (cell / cells[0]) % cells[1];
+    int cz = cell / (cells[0] * cells[1]);
+
+    unsigned n = 0;
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                int x = (cx + dx + cells[0]) % cells[0];
+                int y = (cy + dy + cells[1]) % cells[1];
+                int z = (cz + dz + cells[2]) % cells[2];
+                out[n++] = static_cast<unsigned>((z * cells[1] + y) * cells[0] + x);
+            }
+        }
+    }
+
+    // With fewer than three cells along an axis, the periodic wrap visits some cells twice
+    std::sort(out, out + n);
+    return static_cast<unsigned>(std::unique(out, out + n) - out);
+}
+
+void djinn::CellList::build(const djinn::Vec3 *positions, unsigned count) {
+    this->positions = positions;
+    this->count = count;
+
+    unsigned totalCells = cellCount();
+    cellStart.assign(totalCells + 1, 0);
+    cellOf.resize(count);
+    sorted.resize(count);
+
+    // Counting sort of the particles by cell
+    for (unsigned i = 0; i < count; i++) {
+        cellOf[i] = cellIndex(positions[i]);
+        cellStart[cellOf[i] + 1]++;
+    }
+
+    for (unsigned c = 0; c < totalCells; c++) {
+        cellStart[c + 1] += cellStart[c];
+    }
+
+    std::vector<unsigned> cursor(cellStart.begin(), cellStart.end() - 1);
+    for (unsigned i = 0; i < count; i++) {
+        sorted[cursor[cellOf[i]]++] = i;
+    }
+}
@@ -0,0 +1,559 @@
+/**
+ * @file collider.cpp
+ * @brief Define methods for static colliders and swept (continuous) collision tests
+ * @author Catyre
+ */
+
+#include "djinn/collider.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <assert.h>
+
+djinn::PlaneCollider::PlaneCollider(const djinn::Vec3 &normal, const djinn::real offset) : offset(offset) {
+    assert(normal.squareMagnitude() > 0);
+    this->normal = normal * (1 / normal.magnitude());
+}
+
+bool djinn::PlaneCollider::sweep(const djinn::Vec3 &start, const djinn::Vec3 &end, djinn::real radius,
+                                 djinn::real &t, djinn::Vec3 &normal) const {
+    // Distances of the sphere's surface from the plane at either end of the path
+    djinn::real d0 = distance(start) - radius;
+    djinn::real d1 = distance(end) - radius;
+
+    // Ends up clear of the plane, or isn't moving into it
+    if (d1 >= 0 || d1 >= d0)
+        return false;
+
+    // Started too deep behind the plane to have come through it
+    if (d0 < -skin)
+        return false;
+
+    t = (d0 > 0) ? d0 / (d0 - d1) : 0;
+    normal = this->normal;
+    return true;
+}
+
+bool djinn::PlaneCollider::penetration(const djinn::Vec3 &point, djinn::real radius, djinn::real &depth,
+                                       djinn::Vec3 &normal) const {
+    djinn::real d = distance(point) - radius;
+    if (d >= 0)
+        return false;
+
+    depth = -d;
+    normal = this->normal;
+    return true;
+}
+
+djinn::SphereCollider::SphereCollider(const djinn::Vec3 &centre, const djinn::real radius)
+    : centre(centre), radius(radius) {
+    assert(radius > 0);
+}
+
+bool djinn::SphereCollider::sweep(const djinn::Vec3 &start, const djinn::Vec3 &end, djinn::real radius,
+                                  djinn::real &t, djinn::Vec3 &normal) const {
+    // Sweeping a sphere against a sphere is sweeping a point against their combined radius
+    djinn::real reach = this->radius + radius;
+    djinn::Vec3 m = start - centre;
+    djinn::Vec3 d = end - start;
+
+    djinn::real c = m.squareMagnitude() - reach * reach;
+    djinn::real b = m * d;
+
+    // Not moving towards the centre
+    if (b >= 0)
+        return false;
+
+    if (c <= 0) {
+        // Starting inside: only a shallow start counts as touching
+        if (real_sqrt(m.squareMagnitude()) < reach - skin)
+            return false;
+        t = 0;
+    } else {
+        djinn::real a = d.squareMagnitude();
+        djinn::real discriminant = b * b - a * c;
+        if (discriminant < 0)
+            return false;
+
+        t = (-b - real_sqrt(discriminant)) / a;
+        if (t > 1)
+            return false;
+    }
+
+    normal = (m + d * t).normalize();
+    return true;
+}
+
+bool djinn::SphereCollider::penetration(const djinn::Vec3 &point, djinn::real radius, djinn::real &depth,
+                                        djinn::Vec3 &normal) const {
+    djinn::real reach = this->radius + radius;
+    djinn::Vec3 m = point - centre;
+    djinn::real distanceSq = m.squareMagnitude();
+    if (distanceSq >= reach * reach)
+        return false;
+
+    djinn::real distance = real_sqrt(distanceSq);
+    depth = reach - distance;
+    // A point at the centre is pushed out along an arbitrary axis
+    normal = (distance > 0) ? m * (1 / distance) : djinn::Vec3(0, 1, 0);
+    return true;
+}
+
+bool djinn::SphereCollider::bounds(djinn::Vec3 &min, djinn::Vec3 &max) const {
+    min = centre - djinn::Vec3(radius, radius, radius);
+    max = centre + djinn::Vec3(radius, radius, radius);
+    return true;
+}
+
+djinn::BoxCollider::BoxCollider(const djinn::Vec3 &centre, const djinn::Vec3 &halfSize)
+    : centre(centre), halfSize(halfSize) {
+    assert(halfSize.x > 0 && halfSize.y > 0 && halfSize.z > 0);
+}
+
+bool djinn::BoxCollider::sweep(const djinn::Vec3 &start, const djinn::Vec3 &end, djinn::real radius,
+                               djinn::real &t, djinn::Vec3 &normal) const {
+    // Slab test of the path against the box grown by the radius
+    const djinn::real *s = &start.x;
+    const djinn::real *e = &end.x;
+    const djinn::real *c = &centre.x;
+    const djinn::real *h = &halfSize.x;
+
+    djinn::real enter = -REAL_MAX;
+    djinn::real exit = REAL_MAX;
+    unsigned enterAxis = 0;
+    djinn::real enterSign = 0;
+
+    for (unsigned axis = 0; axis < 3; axis++) {
+        djinn::real lo = c[axis] - h[axis] - radius;
+        djinn::real hi = c[axis] + h[axis] + radius;
+        djinn::real d = e[axis] - s[axis];
+
+        if (d == 0) {
+            if (s[axis] < lo || s[axis] > hi)
+                return false;
+            continue;
+        }
+
+        // Crossing the near face of this slab is entering through it
+        djinn::real tLo = (lo - s[axis]) / d;
+        djinn::real tHi = (hi - s[axis]) / d;
+        djinn::real sign = -1;
+        if (tLo > tHi) {
+            std::swap(tLo, tHi);
+            sign = 1;
+        }
+
+        if (tLo > enter) {
+            enter = tLo;
+            enterAxis = axis;
+            enterSign = sign;
+        }
+        exit = std::min(exit, tHi);
+
+        if (enter > exit || exit < 0)
+            return false;
+    }
+
+    // A path parallel to every slab it is inside of isn't moving into the box
+    if (enterSign == 0 || enter > 1)
+        return false;
+
+    // Starting inside: only a shallow start counts as touching
+    djinn::real depth = (enterSign > 0) ? (c[enterAxis] + h[enterAxis] + radius) - s[enterAxis]
+                                        : s[enterAxis] - (c[enterAxis] - h[enterAxis] - radius);
+    if (enter < 0 && depth > skin)
+        return false;
+
+    t = std::max(enter, djinn::real(0));
+    normal = djinn::Vec3();
+    (&normal.x)[enterAxis] = enterSign;
+    return true;
+}
+
+bool djinn::BoxCollider::penetration(const djinn::Vec3 &point, djinn::real radius, djinn::real &depth,
+                                     djinn::Vec3 &normal) const {
+    djinn::Vec3 local = point - centre;
+    const djinn::real *p = &local.x;
+    const djinn::real *h = &halfSize.x;
+
+    // Closest point of the box to the point
+    djinn::Vec3 closest;
+    djinn::real *q = &closest.x;
+    bool inside = true;
+    for (unsigned axis = 0; axis < 3; axis++) {
+        q[axis] = std::max(-h[axis], std::min(p[axis], h[axis]));
+        if (q[axis] != p[axis])
+            inside = false;
+    }
+
+    if (!inside) {
+        djinn::Vec3 away = local - closest;
+        djinn::real distanceSq = away.squareMagnitude();
+        if (distanceSq >= radius * radius)
+            return false;
+
+        djinn::real distance = real_sqrt(distanceSq);
+        depth = radius - distance;
+        normal = away * (1 / distance);
+        return true;
+    }
+
+    // Inside the box: push out through the nearest face
+    unsigned axis = 0;
+    djinn::real nearest = REAL_MAX;
+    for (unsigned a = 0; a < 3; a++) {
+        djinn::real toFace = h[a] - real_abs(p[a]);
+        if (toFace < nearest) {
+            nearest = toFace;
+            axis = a;
+        }
+    }
+
+    depth = nearest + radius;
+    normal = djinn::Vec3();
+    (&normal.x)[axis] = (p[axis] < 0) ? -1 : 1;
+    return true;
+}
+
+bool djinn::BoxCollider::bounds(djinn::Vec3 &min, djinn::Vec3 &max) const {
+    min = centre - halfSize;
+    max = centre + halfSize;
+    return true;
+}
+
+djinn::TriangleCollider::TriangleCollider(const djinn::Vec3 &a, const djinn::Vec3 &b, const djinn::Vec3 &c) {
+    vertices[0] = a;
+    vertices[1] = b;
+    vertices[2] = c;
+
+    normal = ((b - a) % (c - a)).normalize();
+    assert(normal.squareMagnitude() > 0);
+}
+
+djinn::Vec3 djinn::TriangleCollider::closestPoint(const djinn::Vec3 &point) const {
+    // Voronoi region test, from Ericson's Real-Time Collision Detection
+    const djinn::Vec3 &a = vertices[0];
+    const djinn::Vec3 &b = vertices[1];
+    const djinn::Vec3 &c = vertices[2];
+
+    djinn::Vec3 ab = b - a;
+    djinn::Vec3 ac = c - a;
+    djinn::Vec3 ap = point - a;
+    djinn::real d1 = ab * ap;
+    djinn::real d2 = ac * ap;
+    if (d1 <= 0 && d2 <= 0)
+        return a;
+
+    djinn::Vec3 bp = point - b;
+    djinn::real d3 = ab * bp;
+    djinn::real d4 = ac * bp;
+    if (d3 >= 0 && d4 <= d3)
+        return b;
+
+    djinn::real vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0)
+        return a + ab * (d1 / (d1 - d3));
+
+    djinn::Vec3 cp = point - c;
+    djinn::real d5 = ab * cp;
+    djinn::real d6 = ac * cp;
+    if (d6 >= 0 && d5 <= d6)
+        return c;
+
+    djinn::real vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0)
+        return a + ac * (d2 / (d2 - d6));
+
+    djinn::real va = d3 * d6 - d5 * d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    djinn::real denominator = 1 / (va + vb + vc);
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+bool djinn::TriangleCollider::sweep(const djinn::Vec3 &start, const djinn::Vec3 &end, djinn::real radius,
+                                    djinn::real &t, djinn::Vec3 &normal) const {
+    // Work on the side of the face the path starts from
+    djinn::real side = this->normal * (start - vertices[0]);
+    djinn::Vec3 n = (side >= 0) ? this->normal : this->normal * -1;
+
+    djinn::real d0 = n * (start - vertices[0]) - radius;
+    djinn::real d1 = n * (end - vertices[0]) - radius;
+    if (d1 >= 0 || d1 >= d0 || d0 < -skin)
+        return false;
+
+    djinn::real hit = (d0 > 0) ? d0 / (d0 - d1) : 0;
+
+    // The sphere touches the face's plane here; it must be over the triangle
+    djinn::Vec3 contact = start + (end - start) * hit - n * (d0 > 0 ? radius : radius + d0);
+    djinn::Vec3 e0 = vertices[1] - vertices[0];
+    djinn::Vec3 e1 = vertices[2] - vertices[1];
+    djinn::Vec3 e2 = vertices[0] - vertices[2];
+    if ((e0 % (contact - vertices[0])) * this->normal < 0 || (e1 % (contact - vertices[1])) * this->normal < 0 ||
+        (e2 % (contact - vertices[2])) * this->normal < 0)
+        return false;
+
+    t = hit;
+    normal = n;
+    return true;
+}
+
+bool djinn::TriangleCollider::penetration(const djinn::Vec3 &point, djinn::real radius, djinn::real &depth,
+                                          djinn::Vec3 &normal) const {
+    djinn::Vec3 away = point - closestPoint(point);
+    djinn::real distanceSq = away.squareMagnitude();
+    if (distanceSq >= radius * radius)
+        return false;
+
+    djinn::real distance = real_sqrt(distanceSq);
+    depth = radius - distance;
+    if (distance > 0) {
+        normal = away * (1 / distance);
+    } else {
+        // Exactly on the face: push out of the front
+        normal = this->normal;
+    }
+    return true;
+}
+
+bool djinn::TriangleCollider::bounds(djinn::Vec3 &min, djinn::Vec3 &max) const {
+    min = vertices[0];
+    max = vertices[0];
+    for (unsigned v = 1; v < 3; v++) {
+        min = djinn::Vec3(std::min(min.x, vertices[v].x), std::min(min.y, vertices[v].y), std::min(min.z, vertices[v].z));
+        max = djinn::Vec3(std::max(max.x, vertices[v].x), std::max(max.y, vertices[v].y), std::max(max.z, vertices[v].z));
+    }
+    return true;
+}
+
+void djinn::StaticColliderSet::add(djinn::StaticCollider *collider) {
+    colliders.push_back(collider);
+    dirty = true;
+}
+
+void djinn::StaticColliderSet::addMesh(const djinn::Vec3 *vertices, const unsigned *indices, unsigned triangleCount) {
+    triangles.reserve(triangles.size() + triangleCount);
+    for (unsigned i = 0; i < triangleCount; i++) {
+        const unsigned *tri = indices + 3 * i;
+        triangles.emplace_back(new TriangleCollider(vertices[tri[0]], vertices[tri[1]], vertices[tri[2]]));
+        triangles.back()->setSkin(skin);
+    }
+    dirty = true;
+
+    spdlog::info("Added mesh of {} triangles to static collider set", triangleCount);
+}
+
+void djinn::StaticColliderSet::clear() {
+    colliders.clear();
+    triangles.clear();
+    items.clear();
+    unbounded.clear();
+    nodes.clear();
+    dirty = false;
+}
+
+void djinn::StaticColliderSet::build() {
+    items.clear();
+    itemMin.clear();
+    itemMax.clear();
+    itemCentre.clear();
+    unbounded.clear();
+    nodes.clear();
+
+    auto gather = [&](const StaticCollider *collider) {
+        djinn::Vec3 min, max;
+        if (!collider->bounds(min, max)) {
+            unbounded.push_back(collider);
+            return;
+        }
+
+        items.push_back(collider);
+        itemMin.push_back(min);
+        itemMax.push_back(max);
+        itemCentre.push_back((min + max) * 0.5);
+    };
+
+    for (const StaticCollider *collider : colliders) {
+        gather(collider);
+    }
+    for (const std::unique_ptr<TriangleCollider> &triangle : triangles) {
+        gather(triangle.get());
+    }
+
+    if (!items.empty()) {
+        nodes.reserve(2 * items.size());
+        buildNode(0, static_cast<unsigned>(items.size()));
+    }
+
+    dirty = false;
+
+    spdlog::info("Built static collider hierarchy: {} colliders, {} nodes, {} unbounded", items.size(), nodes.size(),
+                 unbounded.size());
+}
+
+unsigned djinn::StaticColliderSet::buildNode(unsigned first, unsigned count) {
+    // Colliders per leaf
+    const unsigned LEAF_SIZE = 4;
+
+    unsigned index = static_cast<unsigned>(nodes.size());
+    nodes.push_back(Node());
+
+    // Box around the colliders, and around their centres
+    djinn::Vec3 min = itemMin[first], max = itemMax[first];
+    djinn::Vec3 centreMin = itemCentre[first], centreMax = itemCentre[first];
+    for (unsigned i = first + 1; i < first + count; i++) {
+        for (unsigned axis = 0; axis < 3; axis++) {
+            (&min.x)[axis] = std::min((&min.x)[axis], (&itemMin[i].x)[axis]);
+            (&max.x)[axis] = std::max((&max.x)[axis], (&itemMax[i].x)[axis]);
+            (&centreMin.x)[axis] = std::min((&centreMin.x)[axis], (&itemCentre[i].x)[axis]);
+            (&centreMax.x)[axis] = std::max((&centreMax.x)[axis], (&itemCentre[i].x)[axis]);
+        }
+    }
+
+    nodes[index].min = min;
+    nodes[index].max = max;
+
+    if (count <= LEAF_SIZE) {
+        nodes[index].first = first;
+        nodes[index].count = count;
+        return index;
+    }
+
+    // Split at the median centre along the longest axis of the centres
+    djinn::Vec3 extent = centreMax - centreMin;
+    unsigned axis = 0;
+    if (extent.y > (&extent.x)[axis])
+        axis = 1;
+    if (extent.z > (&extent.x)[axis])
+        axis = 2;
+
+    std::vector<unsigned> order(count);
+    for (unsigned i = 0; i < count; i++) {
+        order[i] = first + i;
+    }
+
+    unsigned half = count / 2;
+    std::nth_element(order.begin(), order.begin() + half, order.end(), [&](unsigned a, unsigned b) {
+        return (&itemCentre[a].x)[axis] < (&itemCentre[b].x)[axis];
+    });
+
+    // Apply the permutation to the item arrays
+    std::vector<const StaticCollider *> sortedItems(count);
+    std::vector<djinn::Vec3> sortedMin(count), sortedMax(count), sortedCentre(count);
+    for (unsigned i = 0; i < count; i++) {
+        sortedItems[i] = items[order[i]];
+        sortedMin[i] = itemMin[order[i]];
+        sortedMax[i] = itemMax[order[i]];
+        sortedCentre[i] = itemCentre[order[i]];
+    }
+    std::copy(sortedItems.begin(), sortedItems.end(), items.begin() + first);
+    std::copy(sortedMin.begin(), sortedMin.end(), itemMin.begin() + first);
+    std::copy(sortedMax.begin(), sortedMax.end(), itemMax.begin() + first);
+    std::copy(sortedCentre.begin(), sortedCentre.end(), itemCentre.begin() + first);
+
+    // The left child follows this node; the right child's index is kept in first
+    buildNode(first, half);
+    unsigned right = buildNode(first + half, count - half);
+
+    nodes[index].first = right;
+    nodes[index].count = 0;
+    return index;
+}
+
+void djinn::StaticColliderSet::buildIfDirty() const {
+    if (!dirty)
+        return;
+
+    // Queries may run on several threads at once; only one of them rebuilds
+    std::lock_guard<std::mutex> lock(buildMutex);
+    if (dirty)
+        const_cast<StaticColliderSet *>(this)->build();
+}
+
+template <typename Function>
+void djinn::StaticColliderSet::query(const djinn::Vec3 &min, const djinn::Vec3 &max, Function fn) const {
+    buildIfDirty();
+
+    for (const StaticCollider *collider : unbounded) {
+        fn(collider);
+    }
+
+    if (nodes.empty())
+        return;
+
+    auto overlaps = [&](const djinn::Vec3 &lo, const djinn::Vec3 &hi) {
+        return lo.x <= max.x && hi.x >= min.x && lo.y <= max.y && hi.y >= min.y && lo.z <= max.z && hi.z >= min.z;
+    };
+
+    // Depth is logarithmic in the number of colliders, so a small fixed stack is plenty
+    unsigned stack[64];
+    unsigned top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node &node = nodes[stack[--top]];
+        if (!overlaps(node.min, node.max))
+            continue;
+
+        if (node.count > 0) {
+            for (unsigned i = node.first; i < node.first + node.count; i++) {
+                if (overlaps(itemMin[i], itemMax[i]))
+                    fn(items[i]);
+            }
+            continue;
+        }
+
+        unsigned index = static_cast<unsigned>(&node - nodes.data());
+        stack[top++] = node.first;
+        stack[top++] = index + 1;
+    }
+}
+
+bool djinn::StaticColliderSet::sweep(const djinn::Vec3 &start, const djinn::Vec3 &end, djinn::real radius,
+                                     djinn::real &t, djinn::Vec3 &normal) const {
+    djinn::Vec3 grow(radius + skin, radius + skin, radius + skin);
+    djinn::Vec3 min(std::min(start.x, end.x), std::min(start.y, end.y), std::min(start.z, end.z));
+    djinn::Vec3 max(std::max(start.x, end.x), std::max(start.y, end.y), std::max(start.z, end.z));
+
+    bool found = false;
+    query(min - grow, max + grow, [&](const StaticCollider *collider) {
+        djinn::real hit;
+        djinn::Vec3 n;
+        if (collider->sweep(start, end, radius, hit, n) && (!found || hit < t)) {
+            found = true;
+            t = hit;
+            normal = n;
+        }
+    });
+
+    return found;
+}
+
+bool djinn::StaticColliderSet::penetration(const djinn::Vec3 &point, djinn::real radius, djinn::real &depth,
+                                           djinn::Vec3 &normal) const {
+    djinn::Vec3 grow(radius, radius, radius);
+
+    bool found = false;
+    query(point - grow, point + grow, [&](const StaticCollider *collider) {
+        djinn::real d;
+        djinn::Vec3 n;
+        if (collider->penetration(point, radius, d, n) && (!found || d > depth)) {
+            found = true;
+            depth = d;
+            normal = n;
+        }
+    });
+
+    return found;
+}
+
+bool djinn::StaticColliderSet::bounds(djinn::Vec3 &min, djinn::Vec3 &max) const {
+    buildIfDirty();
+
+    if (!unbounded.empty() || nodes.empty())
+        return false;
+
+    min = nodes[0].min;
+    max = nodes[0].max;
+    return true;
+}
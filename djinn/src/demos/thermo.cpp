@@ -22,12 +22,18 @@
 #define CAMERA_IMPLEMENTATION
 
 djinn::real dt = 1e-2;
-djinn::real dr = 1e-3;
 djinn::real potential;
-djinn::real sigma = 0.34;   // Lennard-Jones parameter
+djinn::real sigma = 0.034;   // Lennard-Jones parameter (argon's 0.34 nm, scaled so the unit box holds a dilute gas)
 djinn::real epsilon = 0.38e-6; // Lennard-Jones parameter
 djinn::LennardJones lj = djinn::LennardJones(sigma, epsilon);
 
+// Interaction cutoff: at 2.5 sigma the potential is down to ~1.6% of its well depth
+djinn::real cutoff = 2.5 * sigma;
+
+// Lennard-Jones as a table. Pairs closer than 0.8 sigma feel the force at 0.8 sigma, so
+//      particles that happen to start on top of each other don't blow apart
+djinn::TabulatedPotential softLJ = djinn::TabulatedPotential(lj, 0.8 * sigma, cutoff);
+
 // Some helpful functions for calculating random numbers on an interval
 djinn::real randomReal() {
     return (djinn::real)(rand()) / (djinn::real)(RAND_MAX);
@@ -67,61 +73,6 @@ void checkBoundaries(djinn::Particle *particles, djinn::Vec3 bounds, int num_par
     }
 }
 
-// Calculates Lennard-Jones force of each pair of particles
-void calculateLJ(djinn::Particle particles[], int num_particles, djinn::Vec3 bounds) {
-    djinn::Vec3 p_i, p_j, r_vec;
-    djinn::real r_sq, r_mag;
-    
-    // Calculate this once outside the loop
-    djinn::real cutoff_sq = 100; 
-
-    for (int i = 0; i < num_particles; i++) {
-        p_i = particles[i].getPosition();
-
-        for (int j = 0; j < i; j++) {
-            p_j = particles[j].getPosition();
-            r_vec = p_i - p_j;
-
-            // 2. Apply the Minimum Image Convention per axis
-            if (r_vec.x > bounds.x * 0.5f) r_vec.x -= bounds.x;
-            else if (r_vec.x < -bounds.x * 0.5f) r_vec.x += bounds.x;
-
-            if (r_vec.y > bounds.y * 0.5f) r_vec.y -= bounds.y;
-            else if (r_vec.y < -bounds.y * 0.5f) r_vec.y += bounds.y;
-
-            if (r_vec.z > bounds.z * 0.5f) r_vec.z -= bounds.z;
-            else if (r_vec.z < -bounds.z * 0.5f) r_vec.z += bounds.z;
-            
-
-            if (r_vec < djinn::Vec3(3e-1, 3e-1, 3e-1)) {
-              r_vec = djinn::Vec3(3e-1, 3e-1, 3e-1);
-            }
-
-            // Calculate squared distance manually to avoid library overhead
-            r_sq = (r_vec.x * r_vec.x) + (r_vec.y * r_vec.y) + (r_vec.z * r_vec.z);
-            // Prevent division by zero and physics explosions
-            djinn::real safe_r_sq = r_sq;
-            if (safe_r_sq < 0.01) {
-                safe_r_sq = 0.01; 
-            }
-
-            r_mag = sqrt(safe_r_sq);
-            
-            if (r_sq < cutoff_sq) {
-                // Only calculate the expensive square root if interaction is guaranteed
-                r_mag = sqrt(r_sq); 
-                
-                // Apply force to particle i
-                lj.updateForce(&particles[i], r_vec, r_mag, dr);
-                
-                // Apply equal and opposite force to particle j
-                lj.updateForce(&particles[j], r_vec * -1.0, r_mag, dr);
-            }
-        }
-    }
-}
-
-
 int main() {
     // Set up logging
     try {
@@ -160,6 +111,10 @@ int main() {
     djinn::Vec3 bounds = djinn::Vec3(1, 1, 1);
     Vector3 sq_center = Vector3{0.5, 0.5, 0.5};
 
+    // The registry finds the pairs within the cutoff with a cell list, applying the
+    //      Minimum Image Convention per axis
+    u_reg.setPeriodicBox(bounds, cutoff);
+
     // Define a big array of particles
     int num_particles = 3000;
     djinn::Particle particles[num_particles];
@@ -179,7 +134,7 @@ int main() {
       particles[i].setVelocity(randomReal(-1, 1), randomReal(-1, 1), randomReal(-1, 1));
       particles[i].setMass(0.05f);
 
-      u_reg.add(&particles[i], &lj);
+      u_reg.add(&particles[i], &softLJ);
     }
 
 
@@ -228,7 +183,7 @@ int main() {
             djinn::real sim_dt = dt / sub_steps; 
 
             //for (int step = 0; step < sub_steps; step++) {
-                calculateLJ(particles, num_particles, bounds);
+                u_reg.updatePotentials(sim_dt);
                 u_reg.integrateAll(sim_dt);
                 checkBoundaries(&particles[0], bounds, num_particles);
             //}
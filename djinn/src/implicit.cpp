@@ -0,0 +1,301 @@
+/**
+ * @file implicit.cpp
+ * @brief Define methods for the implicit (backward Euler) integrator for spring networks
+ * @author Catyre
+ */
+
+#include "djinn/implicit.h"
+#include "spdlog/spdlog.h"
+#include <assert.h>
+
+djinn::Vec3 djinn::ImplicitSpringSolver::multiply(const Block &m, const djinn::Vec3 &v) {
+    return djinn::Vec3(m.xx * v.x + m.xy * v.y + m.xz * v.z,
+                       m.xy * v.x + m.yy * v.y + m.yz * v.z,
+                       m.xz * v.x + m.yz * v.y + m.zz * v.z);
+}
+
+namespace {
+    /**
+     * Force on the end at d (d = this end - other end) of a spring, and its
+     * derivative with respect to that end's position:
+     * -k (n n^T + max(1 - restLength / length, 0) (I - n n^T)).
+     */
+    template <typename Block>
+    djinn::Vec3 springForce(const djinn::Vec3 &d, djinn::real stiffness, djinn::real restLength,
+                            djinn::real elasticLimit, bool bungee, Block &jacobian) {
+        jacobian = Block{0, 0, 0, 0, 0, 0};
+
+        djinn::real length = d.magnitude();
+        djinn::real stretch = length - restLength;
+        if (length <= 0 || (bungee && stretch <= 0))
+            return djinn::Vec3();
+
+        if (length >= elasticLimit)
+            stiffness *= 0.25;
+
+        djinn::Vec3 n = d * (1 / length);
+        djinn::real across = stretch > 0 ? stretch / length : 0;
+        djinn::real along = 1 - across;
+
+        jacobian.xx = -stiffness * (across + along * n.x * n.x);
+        jacobian.xy = -stiffness * along * n.x * n.y;
+        jacobian.xz = -stiffness * along * n.x * n.z;
+        jacobian.yy = -stiffness * (across + along * n.y * n.y);
+        jacobian.yz = -stiffness * along * n.y * n.z;
+        jacobian.zz = -stiffness * (across + along * n.z * n.z);
+
+        return n * (-stiffness * stretch);
+    }
+} // namespace
+
+bool djinn::ImplicitSpringSolver::owns(const djinn::Particle *particle) const {
+    return network->index.count(const_cast<djinn::Particle *>(particle)) > 0;
+}
+
+void djinn::ImplicitSpringSolver::evaluate() {
+    SpringNetwork &n = *network;
+    unsigned count = static_cast<unsigned>(n.particles.size());
+    unsigned threads = djinn::getThreadCount();
+
+    n.positions.resize(count);
+    for (unsigned i = 0; i < count; i++) {
+        n.positions[i] = n.particles[i]->getPosition();
+    }
+
+    jacobians.resize(n.size());
+    anchoredJacobians.resize(n.anchoredSize());
+    accumulator.reset(threads, count);
+
+    // Same row sweep as SpringNetwork::updateForces, keeping each spring's Jacobian block
+    djinn::parallelFor(count, threads, [&](unsigned begin, unsigned end, unsigned thread) {
+        djinn::Vec3 *force = accumulator.getForces(thread);
+
+        for (unsigned i = begin; i < end; i++) {
+            for (unsigned s = n.firstSpring[i]; s < n.firstSpring[i + 1]; s++) {
+                unsigned j = n.to[s];
+                djinn::Vec3 f = springForce(n.positions[i] - n.positions[j], n.stiffness[s], n.restLengths[s],
+                                            n.elasticLimits[s], n.bungee[s], jacobians[s]);
+                force[i] += f;
+                force[j] -= f;
+            }
+        }
+    });
+
+    djinn::parallelFor(n.anchoredSize(), threads, [&](unsigned begin, unsigned end, unsigned thread) {
+        djinn::Vec3 *force = accumulator.getForces(thread);
+
+        for (unsigned s = begin; s < end; s++) {
+            unsigned i = n.anchoredParticle[s];
+            force[i] += springForce(n.positions[i] - *n.anchors[s], n.anchoredStiffness[s], n.anchoredRestLengths[s],
+                                    n.anchoredElasticLimits[s], false, anchoredJacobians[s]);
+        }
+    });
+
+    forces.resize(count);
+    accumulator.reduce(forces.data());
+}
+
+void djinn::ImplicitSpringSolver::multiplyStiffness(const std::vector<djinn::Vec3> &v, std::vector<djinn::Vec3> &out) {
+    SpringNetwork &n = *network;
+    unsigned count = static_cast<unsigned>(n.particles.size());
+    unsigned threads = djinn::getThreadCount();
+
+    // K v, one sweep over the springs: spring s adds K_s (v_i - v_j) to row i and the opposite to row j
+    accumulator.reset(threads, count);
+    djinn::parallelFor(count, threads, [&](unsigned begin, unsigned end, unsigned thread) {
+        djinn::Vec3 *kv = accumulator.getForces(thread);
+
+        for (unsigned i = begin; i < end; i++) {
+            for (unsigned s = n.firstSpring[i]; s < n.firstSpring[i + 1]; s++) {
+                unsigned j = n.to[s];
+                djinn::Vec3 f = multiply(jacobians[s], v[i] - v[j]);
+                kv[i] += f;
+                kv[j] -= f;
+            }
+        }
+    });
+
+    djinn::parallelFor(n.anchoredSize(), threads, [&](unsigned begin, unsigned end, unsigned thread) {
+        djinn::Vec3 *kv = accumulator.getForces(thread);
+
+        for (unsigned s = begin; s < end; s++) {
+            unsigned i = n.anchoredParticle[s];
+            kv[i] += multiply(anchoredJacobians[s], v[i]);
+        }
+    });
+
+    out.resize(count);
+    accumulator.reduce(out.data());
+}
+
+void djinn::ImplicitSpringSolver::multiplySystem(const std::vector<djinn::Vec3> &v, std::vector<djinn::Vec3> &out,
+                                                 djinn::real h) {
+    unsigned count = static_cast<unsigned>(v.size());
+    djinn::real hSquared = h * h;
+    multiplyStiffness(v, out);
+
+    // M v - h^2 K v; immovable particles keep dv = 0, so their rows are the identity
+    djinn::parallelFor(count, [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned i = begin; i < end; i++) {
+            if (masses[i] > 0)
+                out[i] = v[i] * masses[i] - out[i] * hSquared;
+            else
+                out[i] = v[i];
+        }
+    });
+}
+
+djinn::real djinn::ImplicitSpringSolver::dot(const std::vector<djinn::Vec3> &a, const std::vector<djinn::Vec3> &b) {
+    unsigned count = static_cast<unsigned>(a.size());
+    unsigned threads = djinn::getThreadCount();
+
+    partials.assign(threads, 0);
+    djinn::parallelFor(count, threads, [&](unsigned begin, unsigned end, unsigned block) {
+        djinn::real sum = 0;
+        for (unsigned i = begin; i < end; i++) {
+            sum += a[i] * b[i];
+        }
+        partials[block] = sum;
+    });
+
+    djinn::real sum = 0;
+    for (djinn::real partial : partials) {
+        sum += partial;
+    }
+    return sum;
+}
+
+void djinn::ImplicitSpringSolver::step(djinn::real duration) {
+    assert(duration > 0.0);
+
+    SpringNetwork &n = *network;
+    if (n.dirty)
+        n.build();
+
+    unsigned count = static_cast<unsigned>(n.particles.size());
+    if (count == 0)
+        return;
+
+    const djinn::real h = duration;
+
+    evaluate();
+
+    // Gather the particles; sleeping ones are held in place like anchors
+    velocities.resize(count);
+    masses.resize(count);
+    for (unsigned i = 0; i < count; i++) {
+        djinn::Particle *p = n.particles[i];
+        velocities[i] = p->getVelocity();
+        masses[i] = p->getAwake() && p->hasFiniteMass() ? p->getMass() : 0;
+
+        if (masses[i] > 0)
+            forces[i] += p->getNetForce() + p->getAcceleration() * masses[i];
+    }
+
+    // Right hand side h (f + h K v)
+    multiplyStiffness(velocities, product);
+    residual.resize(count);
+    for (unsigned i = 0; i < count; i++) {
+        if (masses[i] > 0)
+            residual[i] = (forces[i] + product[i] * h) * h;
+        else
+            residual[i] = djinn::Vec3();
+    }
+    djinn::real rhsNorm = dot(residual, residual);
+
+    // Diagonal of M - h^2 K for the preconditioner
+    inverseDiagonal.assign(count, djinn::Vec3());
+    for (unsigned i = 0; i < count; i++) {
+        for (unsigned s = n.firstSpring[i]; s < n.firstSpring[i + 1]; s++) {
+            djinn::Vec3 d(jacobians[s].xx, jacobians[s].yy, jacobians[s].zz);
+            inverseDiagonal[i] += d;
+            inverseDiagonal[n.to[s]] += d;
+        }
+    }
+    for (unsigned s = 0; s < n.anchoredSize(); s++) {
+        const Block &j = anchoredJacobians[s];
+        inverseDiagonal[n.anchoredParticle[s]] += djinn::Vec3(j.xx, j.yy, j.zz);
+    }
+    for (unsigned i = 0; i < count; i++) {
+        djinn::Vec3 &d = inverseDiagonal[i];
+        if (masses[i] > 0)
+            d = djinn::Vec3(1 / (masses[i] - h * h * d.x), 1 / (masses[i] - h * h * d.y), 1 / (masses[i] - h * h * d.z));
+        else
+            d = djinn::Vec3(1, 1, 1);
+    }
+
+    // Start from last step's answer if the network hasn't changed size
+    if (deltaV.size() != count)
+        deltaV.assign(count, djinn::Vec3());
+    for (unsigned i = 0; i < count; i++) {
+        if (masses[i] <= 0)
+            deltaV[i] = djinn::Vec3();
+    }
+
+    // r = b - A dv
+    multiplySystem(deltaV, product, h);
+    for (unsigned i = 0; i < count; i++) {
+        residual[i] -= product[i];
+    }
+
+    // Preconditioned conjugate gradient
+    preconditioned.resize(count);
+    direction.resize(count);
+    for (unsigned i = 0; i < count; i++) {
+        const djinn::Vec3 &d = inverseDiagonal[i];
+        preconditioned[i] = djinn::Vec3(residual[i].x * d.x, residual[i].y * d.y, residual[i].z * d.z);
+        direction[i] = preconditioned[i];
+    }
+
+    djinn::real stop = tolerance * tolerance * rhsNorm;
+    djinn::real rz = dot(residual, preconditioned);
+    djinn::real rr = dot(residual, residual);
+    unsigned iteration = 0;
+
+    for (; iteration < maxIterations && rr > stop; iteration++) {
+        multiplySystem(direction, product, h);
+        djinn::real pAp = dot(direction, product);
+        if (pAp <= 0)
+            break;
+
+        djinn::real alpha = rz / pAp;
+        for (unsigned i = 0; i < count; i++) {
+            deltaV[i].addScaledVector(direction[i], alpha);
+            residual[i].addScaledVector(product[i], -alpha);
+
+            const djinn::Vec3 &d = inverseDiagonal[i];
+            preconditioned[i] = djinn::Vec3(residual[i].x * d.x, residual[i].y * d.y, residual[i].z * d.z);
+        }
+
+        djinn::real rzNext = dot(residual, preconditioned);
+        djinn::real beta = rzNext / rz;
+        rz = rzNext;
+        rr = dot(residual, residual);
+
+        for (unsigned i = 0; i < count; i++) {
+            direction[i] = preconditioned[i] + direction[i] * beta;
+        }
+    }
+
+    lastIterations = iteration;
+    lastResidual = rhsNorm > 0 ? real_sqrt(rr / rhsNorm) : 0;
+
+    // Write the results back; like ParticleStore::integrate, only particles
+    // that moved have their accumulators cleared
+    djinn::parallelFor(count, [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned i = begin; i < end; i++) {
+            if (masses[i] <= 0)
+                continue;
+
+            djinn::Particle *p = n.particles[i];
+            djinn::Vec3 velocity = velocities[i] + deltaV[i];
+            p->setVelocity(velocity);
+            p->setPosition(p->getPosition() + velocity * h);
+            p->clearNetForce();
+            p->setAcceleration(djinn::Vec3());
+        }
+    });
+
+    spdlog::info("Implicit spring step: {} particles, {} CG iterations (residual {})", count, lastIterations,
+                 lastResidual);
+} // void ImplicitSpringSolver::step
@@ -0,0 +1,93 @@
+/**
+ * @file integrator.cpp
+ * @brief Define the integrators the particle world can step its particles with
+ * @author Catyre
+ */
+
+#include "djinn/integrator.h"
+#include "djinn/numerical.h"
+#include "djinn/parallel.h"
+#include <assert.h>
+
+namespace {
+    /**
+     * Kicks every particle with finite mass by kick * duration and then
+     * drifts it by drift * duration, clearing its force and (unless told to
+     * keep it for a closing kick) its acceleration.
+     */
+    void kickDrift(djinn::ParticleStore &store, djinn::real kick, djinn::real drift,
+                   bool keepAccelerations = false) {
+        djinn::Vec3 *positions = store.getPositions();
+        djinn::Vec3 *velocities = store.getVelocities();
+        djinn::Vec3 *accelerations = store.getAccelerations();
+        djinn::Vec3 *netForces = store.getNetForces();
+        const djinn::real *inverseMasses = store.getInverseMasses();
+
+        djinn::parallelFor(store.getActiveCount(), [&](unsigned begin, unsigned end, unsigned) {
+            for (unsigned i = begin; i < end; i++) {
+                if (inverseMasses[i] <= 0.0)
+                    continue;
+
+                velocities[i].addScaledVector(accelerations[i], kick);
+                velocities[i].addScaledVector(netForces[i], kick * inverseMasses[i]);
+                positions[i].addScaledVector(velocities[i], drift);
+
+                netForces[i].clear();
+                if (!keepAccelerations)
+                    accelerations[i].clear();
+            }
+        });
+    }
+} // namespace
+
+void djinn::Integrator::restep(djinn::Vec3 &position, djinn::Vec3 &velocity, const djinn::Vec3 &acceleration,
+                               djinn::real duration) const {
+    djinn::verletAlgorithm(position, velocity, acceleration, duration);
+}
+
+void djinn::SemiImplicitEuler::integrate(djinn::ParticleStore &store, djinn::real duration) {
+    assert(duration > 0.0);
+
+    kickDrift(store, duration, duration);
+}
+
+void djinn::SemiImplicitEuler::restep(djinn::Vec3 &position, djinn::Vec3 &velocity, const djinn::Vec3 &acceleration,
+                                      djinn::real duration) const {
+    velocity.addScaledVector(acceleration, duration);
+    position.addScaledVector(velocity, duration);
+}
+
+void djinn::LeapfrogIntegrator::integrate(djinn::ParticleStore &store, djinn::real duration) {
+    assert(duration > 0.0);
+
+    lastStartLag = started ? 0.5 : 0;
+    kickDrift(store, started ? duration : 0.5 * duration, duration);
+    started = true;
+}
+
+void djinn::VelocityVerlet::integrate(djinn::ParticleStore &store, djinn::real duration) {
+    assert(duration > 0.0);
+
+    // The stored accelerations hold for the whole step, so finish() takes their second half kick
+    kickDrift(store, 0.5 * duration, duration, true);
+}
+
+void djinn::VelocityVerlet::finish(djinn::ParticleStore &store, djinn::real duration) {
+    djinn::Vec3 *velocities = store.getVelocities();
+    djinn::Vec3 *accelerations = store.getAccelerations();
+    const djinn::Vec3 *netForces = store.getNetForces();
+    const djinn::real *inverseMasses = store.getInverseMasses();
+    const djinn::real halfDuration = 0.5 * duration;
+
+    // The forces stay in the store: they open the next step
+    djinn::parallelFor(store.getActiveCount(), [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned i = begin; i < end; i++) {
+            if (inverseMasses[i] <= 0.0)
+                continue;
+
+            velocities[i].addScaledVector(accelerations[i], halfDuration);
+            velocities[i].addScaledVector(netForces[i], halfDuration * inverseMasses[i]);
+            accelerations[i].clear();
+        }
+    });
+}
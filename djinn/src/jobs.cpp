@@ -0,0 +1,189 @@
+/**
+ * @file jobs.cpp
+ * @brief Define methods for the work-stealing job system
+ * @author Catyre
+ */
+
+#include "djinn/jobs.h"
+#include <assert.h>
+
+namespace {
+    // The pool the calling thread works for, and its index in that pool
+    thread_local const djinn::JobSystem *currentSystem = nullptr;
+    thread_local unsigned currentIndex = 0;
+}
+
+djinn::JobSystem::JobSystem(unsigned threads) : threads(0), queued(0), stopping(false) {
+    start(threads);
+}
+
+djinn::JobSystem::~JobSystem() {
+    stop();
+}
+
+void djinn::JobSystem::start(unsigned threads) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    this->threads = threads;
+    stopping = false;
+    queued = 0;
+
+    queues.clear();
+    for (unsigned i = 0; i < threads; i++) {
+        queues.emplace_back(new WorkQueue());
+    }
+
+    // The calling thread is worker 0, so only threads - 1 are started
+    for (unsigned i = 1; i < threads; i++) {
+        workers.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+}
+
+void djinn::JobSystem::stop() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+void djinn::JobSystem::setThreadCount(unsigned threads) {
+    assert(currentSystem != this || currentIndex == 0);
+
+    stop();
+    start(threads);
+}
+
+unsigned djinn::JobSystem::currentWorker() const {
+    return currentSystem == this ? currentIndex : 0;
+}
+
+void djinn::JobSystem::workerLoop(unsigned index) {
+    currentSystem = this;
+    currentIndex = index;
+
+    while (!stopping) {
+        djinn::JobHandle job = take(index);
+        if (job) {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this]() { return stopping || queued > 0; });
+    }
+}
+
+djinn::JobHandle djinn::JobSystem::create(std::function<void()> function) {
+    return std::make_shared<djinn::Job>(std::move(function));
+}
+
+void djinn::JobSystem::addDependency(const djinn::JobHandle &job, const djinn::JobHandle &prerequisite) {
+    std::lock_guard<std::mutex> lock(prerequisite->mutex);
+
+    // Nothing to wait for if the prerequisite is already done
+    if (prerequisite->finished)
+        return;
+
+    job->pending++;
+    prerequisite->dependents.push_back(job);
+}
+
+void djinn::JobSystem::submit(const djinn::JobHandle &job) {
+    // Drop the submission hold; the last prerequisite to finish queues the job otherwise
+    if (--job->pending == 0)
+        enqueue(job);
+}
+
+djinn::JobHandle djinn::JobSystem::run(std::function<void()> function) {
+    djinn::JobHandle job = create(std::move(function));
+    submit(job);
+    return job;
+}
+
+void djinn::JobSystem::enqueue(const djinn::JobHandle &job) {
+    if (threads == 1) {
+        execute(job);
+        return;
+    }
+
+    WorkQueue &queue = *queues[currentWorker()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(job);
+    }
+    queued++;
+
+    // Taking the lock orders this wake-up after any worker that is about to sleep
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    wake.notify_one();
+}
+
+void djinn::JobSystem::execute(const djinn::JobHandle &job) {
+    job->function();
+
+    std::vector<djinn::JobHandle> released;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->finished = true;
+        released.swap(job->dependents);
+    }
+
+    for (const djinn::JobHandle &dependent : released) {
+        if (--dependent->pending == 0)
+            enqueue(dependent);
+    }
+}
+
+djinn::JobHandle djinn::JobSystem::take(unsigned index) {
+    djinn::JobHandle job;
+
+    // Newest job from our own deque first
+    {
+        WorkQueue &own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = own.jobs.back();
+            own.jobs.pop_back();
+        }
+    }
+
+    // Otherwise steal the oldest job of another worker
+    for (unsigned k = 1; !job && k < threads; k++) {
+        WorkQueue &victim = *queues[(index + k) % threads];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+        }
+    }
+
+    if (job)
+        queued--;
+
+    return job;
+}
+
+void djinn::JobSystem::wait(const djinn::JobHandle &job) {
+    unsigned index = currentWorker();
+
+    // Help out rather than block, so waiting inside a job cannot starve the pool
+    while (!job->finished) {
+        djinn::JobHandle other = take(index);
+        if (other)
+            execute(other);
+        else
+            std::this_thread::yield();
+    }
+}
+
+djinn::JobSystem &djinn::JobSystem::getInstance() {
+    static djinn::JobSystem instance(1);
+    return instance;
+}
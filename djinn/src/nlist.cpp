@@ -0,0 +1,89 @@
+/**
+ * @file nlist.cpp
+ * @brief Define methods for Verlet neighbour lists
+ * @author Catyre
+ */
+
+#include "djinn/nlist.h"
+#include "spdlog/spdlog.h"
+#include <assert.h>
+
+void djinn::NeighbourList::setBox(const djinn::Vec3 &bounds, djinn::real cutoff, djinn::real skin) {
+    assert(skin >= 0);
+
+    this->cutoff = cutoff;
+    this->skin = skin;
+    cutoffSq = cutoff * cutoff;
+
+    // Candidate pairs are everything that could reach the cutoff before the next rebuild
+    cellList.setBox(bounds, cutoff + skin);
+    invalidate();
+}
+
+bool djinn::NeighbourList::needsRebuild(const djinn::Vec3 *positions, unsigned count) const {
+    if (!valid || count != reference.size())
+        return true;
+
+    djinn::real limitSq = 0.25 * skin * skin;
+    for (unsigned i = 0; i < count; i++) {
+        // Minimum image, so particles that wrapped through the box don't look like they jumped
+        djinn::Vec3 displacement = cellList.minimumImage(positions[i] - reference[i]);
+        if (displacement.squareMagnitude() > limitSq)
+            return true;
+    }
+
+    return false;
+}
+
+bool djinn::NeighbourList::update(const djinn::Vec3 *positions, unsigned count) {
+    updates++;
+
+    if (!needsRebuild(positions, count))
+        return false;
+
+    rebuild(positions, count);
+    return true;
+}
+
+void djinn::NeighbourList::rebuild(const djinn::Vec3 *positions, unsigned count) {
+    reference.assign(positions, positions + count);
+
+    // Collect every pair within cutoff + skin, counting how many belong to each particle
+    pairScratch.clear();
+    firstNeighbour.assign(count + 1, 0);
+
+    cellList.build(positions, count);
+    cellList.forEachPair([&](unsigned i, unsigned j, const djinn::Vec3 &, djinn::real) {
+        pairScratch.push_back(i);
+        pairScratch.push_back(j);
+        firstNeighbour[i + 1]++;
+    });
+
+    // Lay the pairs out per particle (compressed rows)
+    for (unsigned i = 0; i < count; i++) {
+        firstNeighbour[i + 1] += firstNeighbour[i];
+    }
+
+    neighbours.resize(pairScratch.size() / 2);
+    std::vector<unsigned> cursor(firstNeighbour.begin(), firstNeighbour.end() - 1);
+    for (size_t k = 0; k < pairScratch.size(); k += 2) {
+        neighbours[cursor[pairScratch[k]]++] = pairScratch[k + 1];
+    }
+
+    valid = true;
+    rebuilds++;
+    if (count > 0)
+        listLengthSum += static_cast<djinn::real>(neighbours.size()) / count;
+
+    spdlog::info("Rebuilt neighbour list: {} pairs over {} particles (rebuild {} of {} updates)", neighbours.size(), count, rebuilds, updates);
+}
+
+djinn::real djinn::NeighbourList::getAverageListLength() const {
+    return rebuilds > 0 ? listLengthSum / rebuilds : 0;
+}
+
+void djinn::NeighbourList::resetStatistics() {
+    updates = 0;
+    rebuilds = 0;
+    listLengthSum = 0;
+}
@@ -73,6 +73,20 @@ void djinn::verletAlgorithm(djinn::Vec3 &x, djinn::Vec3 &v, djinn::Vec3 a, djinn
     v = vNew;
 }
 
+void djinn::verletAlgorithm(djinn::Vec3 *x, djinn::Vec3 *v, const djinn::Vec3 *a, const djinn::real *inverseMass, unsigned count, djinn::real dt) {
+    const djinn::real halfDtSq = 0.5 * dt * dt;
+
+    for (unsigned i = 0; i < count; i++) {
+        if (inverseMass[i] <= 0.0)
+            continue;
+
+        // Same update as the single particle version, without the temporaries
+        x[i].addScaledVector(v[i], dt);
+        x[i].addScaledVector(a[i], halfDtSq);
+        v[i].addScaledVector(a[i], dt);
+    }
+}
+
 /*
  * Example verlet algorithm
  * ------------------------
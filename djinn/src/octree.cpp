@@ -0,0 +1,167 @@
+/**
+ * @file octree.cpp
+ * @brief Define methods for the Barnes-Hut octree
+ * @author Catyre
+ */
+
+#include "djinn/octree.h"
+#include <algorithm>
+
+void djinn::Octree::clear() {
+    nodes.clear();
+    bodies.clear();
+    positions = nullptr;
+    masses = nullptr;
+}
+
+void djinn::Octree::build(const djinn::Vec3 *positions, const djinn::real *masses, unsigned count) {
+    clear();
+    if (count == 0)
+        return;
+
+    this->positions = positions;
+    this->masses = masses;
+
+    // Find the bounding cube of every body
+    djinn::Vec3 lower = positions[0];
+    djinn::Vec3 upper = positions[0];
+    for (unsigned i = 1; i < count; i++) {
+        lower.x = std::min(lower.x, positions[i].x);
+        lower.y = std::min(lower.y, positions[i].y);
+        lower.z = std::min(lower.z, positions[i].z);
+        upper.x = std::max(upper.x, positions[i].x);
+        upper.y = std::max(upper.y, positions[i].y);
+        upper.z = std::max(upper.z, positions[i].z);
+    }
+
+    djinn::Vec3 centre = (lower + upper) * 0.5;
+    djinn::real halfWidth = 0.5 * std::max(upper.x - lower.x, std::max(upper.y - lower.y, upper.z - lower.z));
+
+    // Grow the cube slightly so bodies on the boundary fall inside it
+    halfWidth = halfWidth * (1 + 1e-9) + real_epsilon;
+
+    bodies.resize(count);
+    scratch.resize(count);
+    for (unsigned i = 0; i < count; i++)
+        bodies[i] = i;
+
+    // A balanced tree has roughly 2N nodes, so reserve that up front
+    nodes.reserve(2 * count);
+    buildNode(centre, halfWidth, 0, count, 0);
+}
+
+int djinn::Octree::buildNode(const djinn::Vec3 &centre, djinn::real halfWidth, unsigned first, unsigned count, unsigned depth) {
+    int index = static_cast<int>(nodes.size());
+
+    Node node;
+    node.centre = centre;
+    node.halfWidth = halfWidth;
+    node.first = first;
+    node.count = count;
+    std::fill(node.children, node.children + 8, -1);
+
+    // Accumulate the mass and centre of mass of this node
+    node.mass = 0;
+    djinn::Vec3 weighted;
+    for (unsigned k = first; k < first + count; k++) {
+        node.mass += masses[bodies[k]];
+        weighted.addScaledVector(positions[bodies[k]], masses[bodies[k]]);
+    }
+    node.centreOfMass = node.mass > 0 ? weighted / node.mass : centre;
+
+    nodes.push_back(node);
+
+    if (count <= LEAF_SIZE || depth >= MAX_DEPTH)
+        return index;
+
+    // Sort the bodies of this node by octant (counting sort into scratch space)
+    unsigned octantCount[8] = {0};
+    unsigned octantStart[8];
+    for (unsigned k = first; k < first + count; k++) {
+        const djinn::Vec3 &p = positions[bodies[k]];
+        octantCount[(p.x >= centre.x) | ((p.y >= centre.y) << 1) | ((p.z >= centre.z) << 2)]++;
+    }
+
+    octantStart[0] = first;
+    for (unsigned o = 1; o < 8; o++)
+        octantStart[o] = octantStart[o - 1] + octantCount[o - 1];
+
+    unsigned cursor[8];
+    std::copy(octantStart, octantStart + 8, cursor);
+    for (unsigned k = first; k < first + count; k++) {
+        const djinn::Vec3 &p = positions[bodies[k]];
+        scratch[cursor[(p.x >= centre.x) | ((p.y >= centre.y) << 1) | ((p.z >= centre.z) << 2)]++] = bodies[k];
+    }
+    std::copy(scratch.begin() + first, scratch.begin() + first + count, bodies.begin() + first);
+
+    // Recurse into every non-empty octant
+    djinn::real childHalf = 0.5 * halfWidth;
+    for (unsigned o = 0; o < 8; o++) {
+        if (octantCount[o] == 0)
+            continue;
+
+        djinn::Vec3 childCentre(centre.x + ((o & 1) ? childHalf : -childHalf),
+                                centre.y + ((o & 2) ? childHalf : -childHalf),
+                                centre.z + ((o & 4) ? childHalf : -childHalf));
+
+        // Note that nodes may reallocate during recursion, so index rather than hold a reference
+        int child = buildNode(childCentre, childHalf, octantStart[o], octantCount[o], depth + 1);
+        nodes[index].children[o] = child;
+    }
+
+    return index;
+}
+
+djinn::Vec3 djinn::Octree::field(unsigned body, djinn::real theta) const {
+    djinn::Vec3 result;
+    if (nodes.empty())
+        return result;
+
+    const djinn::Vec3 p = positions[body];
+    const djinn::real thetaSq = theta * theta;
+
+    // Depth-first traversal; each level adds at most 7 pending siblings
+    int stack[8 * MAX_DEPTH + 8];
+    unsigned top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node &node = nodes[stack[--top]];
+
+        if (node.isLeaf()) {
+            // Leaves are summed exactly, skipping the body itself
+            for (unsigned k = node.first; k < node.first + node.count; k++) {
+                unsigned other = bodies[k];
+                if (other == body)
+                    continue;
+
+                djinn::Vec3 r = p - positions[other];
+                djinn::real rSq = r.squareMagnitude();
+                if (rSq > 0)
+                    result.addScaledVector(r, masses[other] / (rSq * real_sqrt(rSq)));
+            }
+            continue;
+        }
+
+        // Never approximate a node that contains the body, or it would attract itself
+        bool contains = real_abs(p.x - node.centre.x) <= node.halfWidth &&
+                        real_abs(p.y - node.centre.y) <= node.halfWidth &&
+                        real_abs(p.z - node.centre.z) <= node.halfWidth;
+
+        djinn::Vec3 r = p - node.centreOfMass;
+        djinn::real rSq = r.squareMagnitude();
+        djinn::real width = 2 * node.halfWidth;
+
+        if (!contains && width * width < thetaSq * rSq) {
+            // Far enough away to be treated as a single body
+            result.addScaledVector(r, node.mass / (rSq * real_sqrt(rSq)));
+        } else {
+            for (unsigned o = 0; o < 8; o++) {
+                if (node.children[o] >= 0)
+                    stack[top++] = node.children[o];
+            }
+        }
+    }
+
+    return result;
+}
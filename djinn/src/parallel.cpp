@@ -0,0 +1,43 @@
+/**
+ * @file parallel.cpp
+ * @brief Define the thread count and the per-block force accumulator
+ * @author Catyre
+ */
+
+#include "djinn/parallel.h"
+
+void djinn::setThreadCount(unsigned threads) {
+    djinn::JobSystem::getInstance().setThreadCount(threads);
+}
+
+unsigned djinn::getThreadCount() {
+    return djinn::JobSystem::getInstance().getThreadCount();
+}
+
+void djinn::ForceAccumulator::reset(unsigned threads, unsigned count) {
+    this->threads = std::max(1u, threads);
+    this->count = count;
+
+    forces.assign(static_cast<size_t>(this->threads) * count, djinn::Vec3());
+    energies.assign(this->threads, 0);
+}
+
+djinn::real djinn::ForceAccumulator::reduce(djinn::Vec3 *out) const {
+    // Each block of particles is summed over the threads in order 0, 1, 2, ...
+    djinn::parallelFor(count, threads, [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned i = begin; i < end; i++) {
+            djinn::Vec3 sum = forces[i];
+            for (unsigned t = 1; t < threads; t++) {
+                sum += forces[static_cast<size_t>(t) * count + i];
+            }
+            out[i] = sum;
+        }
+    });
+
+    djinn::real energy = 0;
+    for (unsigned t = 0; t < threads; t++) {
+        energy += energies[t];
+    }
+
+    return energy;
+}
@@ -6,11 +6,52 @@
 
 #include "djinn/particle.h"
 #include "djinn/numerical.h"
+#include "djinn/pstore.h"
 #include "spdlog/spdlog.h"
 #include <assert.h>
 #include <limits>
 #include <sstream>
 
+djinn::Particle::Particle(const djinn::Particle &other)
+    : name(other.name), pos(other.position()), vel(other.velocity()), acc(other.acceleration()),
+      damping(other.dampingRef()), inverseMass(other.inverseMassRef()), netForce(other.force()),
+      netPotential(other.netPotential), isAwake(other.isAwake), canSleep(other.canSleep), store(nullptr), slot(0) {}
+
+djinn::Particle &djinn::Particle::operator=(const djinn::Particle &other) {
+    if (this == &other)
+        return *this;
+
+    name = other.name;
+    position() = other.position();
+    velocity() = other.velocity();
+    acceleration() = other.acceleration();
+    dampingRef() = other.dampingRef();
+    inverseMassRef() = other.inverseMassRef();
+    force() = other.force();
+    netPotential = other.netPotential;
+    isAwake = other.isAwake;
+    canSleep = other.canSleep;
+    return *this;
+}
+
+djinn::Particle::~Particle() {
+    if (store)
+        store->release(this);
+}
+
+djinn::Vec3 &djinn::Particle::position() { return store ? store->getPositions()[slot] : pos; }
+const djinn::Vec3 &djinn::Particle::position() const { return store ? store->getPositions()[slot] : pos; }
+djinn::Vec3 &djinn::Particle::velocity() { return store ? store->getVelocities()[slot] : vel; }
+const djinn::Vec3 &djinn::Particle::velocity() const { return store ? store->getVelocities()[slot] : vel; }
+djinn::Vec3 &djinn::Particle::acceleration() { return store ? store->getAccelerations()[slot] : acc; }
+const djinn::Vec3 &djinn::Particle::acceleration() const { return store ? store->getAccelerations()[slot] : acc; }
+djinn::Vec3 &djinn::Particle::force() { return store ? store->getNetForces()[slot] : netForce; }
+const djinn::Vec3 &djinn::Particle::force() const { return store ? store->getNetForces()[slot] : netForce; }
+djinn::real &djinn::Particle::inverseMassRef() { return store ? store->getInverseMasses()[slot] : inverseMass; }
+djinn::real djinn::Particle::inverseMassRef() const { return store ? store->getInverseMasses()[slot] : inverseMass; }
+djinn::real &djinn::Particle::dampingRef() { return store ? store->getDampings()[slot] : damping; }
+djinn::real djinn::Particle::dampingRef() const { return store ? store->getDampings()[slot] : damping; }
+
 std::string djinn::Particle::toString() {
     std::stringstream ss;
 
@@ -18,10 +59,10 @@ std::string djinn::Particle::toString() {
         ss << this->name << ": " << std::endl;
     }
 
-    ss << std::scientific << "Position [m]:         |" << this->pos.toString() << "| = " << this->pos.magnitude() << std::endl
-       << "Velocity [m/s]:       |" << this->vel.toString() << "| = " << this->vel.magnitude() << std::endl
-       << "Acceleration [m/s^2]: |" << this->acc.toString() << "| = " << this->acc.magnitude() << std::endl
-       << "Net force [N]:        |" << this->netForce.toString() << "| = " << this->netForce.magnitude() << std::endl
+    ss << std::scientific << "Position [m]:         |" << position().toString() << "| = " << position().magnitude() << std::endl
+       << "Velocity [m/s]:       |" << velocity().toString() << "| = " << velocity().magnitude() << std::endl
+       << "Acceleration [m/s^2]: |" << acceleration().toString() << "| = " << acceleration().magnitude() << std::endl
+       << "Net force [N]:        |" << force().toString() << "| = " << force().magnitude() << std::endl
        << "Kinetic Energy [J]: " << this->kineticEnergy() << std::endl;
 
     return ss.str();
@@ -29,28 +70,31 @@ std::string djinn::Particle::toString() {
 
 void djinn::Particle::integrate(djinn::real dt) {
     // We won't integrate particles with infinite or negative mass
-    if (inverseMass <= 0.0)
+    if (inverseMassRef() <= 0.0)
         return;
 
     assert(dt > 0.0);
 
-    djinn::Vec3 pos0 = pos;
-    acc.addScaledVector(netForce, inverseMass);
-    spdlog::info("Particle with net force of: {}", netForce.toString());
+    djinn::Vec3 &x = position();
+    djinn::Vec3 &a = acceleration();
+
+    djinn::Vec3 pos0 = x;
+    a.addScaledVector(force(), inverseMassRef());
+    spdlog::info("Particle with net force of: {}", force().toString());
 
-    djinn::verletAlgorithm(pos, vel, acc, dt);
+    djinn::verletAlgorithm(x, velocity(), a, dt);
 
-    djinn::Vec3 delta_x = pos - pos0;
+    djinn::Vec3 delta_x = x - pos0;
 
     clearNetForce();
     clearNetPotential();
-    acc = djinn::Vec3();
+    a = djinn::Vec3();
 
     //spdlog::info("Particle \"{}\" integrated and forces/acceleration cleared (Δx = {})", this->name, delta_x.toString());
 }
 
 djinn::real djinn::Particle::kineticEnergy() {
-    return .5 * ((real)1.0) / inverseMass * real_pow(vel.magnitude(), 2);
+    return .5 * ((real)1.0) / inverseMassRef() * real_pow(velocity().magnitude(), 2);
 }
 
 std::string djinn::Particle::getName() const {
@@ -60,90 +104,98 @@ std::string djinn::Particle::getName() const {
 // Set the mass (specfically the inverse mass) of the particle
 void djinn::Particle::setMass(const djinn::real mass) {
     assert(mass != 0);
-    Particle::inverseMass = ((real)1.0) / mass;
+    inverseMassRef() = ((real)1.0) / mass;
 }
 
 // Set the position of the particle to the given vector
 void djinn::Particle::setPosition(const djinn::Vec3 &pos) {
-    Particle::pos = pos;
+    position() = pos;
 }
 
 // Set the position of the particle given three reals representing the XYZ coordinates
 void djinn::Particle::setPosition(const djinn::real x, const djinn::real y, const djinn::real z) {
-    pos.x = x;
-    pos.y = y;
-    pos.z = z;
+    djinn::Vec3 &target = position();
+    target.x = x;
+    target.y = y;
+    target.z = z;
 }
 
 // Return position of particle
 djinn::Vec3 djinn::Particle::getPosition() const {
-    return pos;
+    return position();
 }
 
 // Get the particle's position and set it equal to the given vector
 void djinn::Particle::getPosition(djinn::Vec3 *pos) {
-    *pos = djinn::Particle::pos;
+    *pos = position();
 }
 
 // Set the velocity of the particle to the given vector
 void djinn::Particle::setVelocity(const djinn::Vec3 &vel) {
-    djinn::Particle::vel = vel;
+    velocity() = vel;
 }
 
 // Set the velocity of the particle to the given XYZ values
 void djinn::Particle::setVelocity(const djinn::real x, const djinn::real y, const djinn::real z) {
-    vel.x = x;
-    vel.y = y;
-    vel.z = z;
+    djinn::Vec3 &target = velocity();
+    target.x = x;
+    target.y = y;
+    target.z = z;
 }
 
 // Return the velocity of the particle
 djinn::Vec3 djinn::Particle::getVelocity() const {
-    return vel;
+    return velocity();
 }
 
 // Get the particle's velocity and set it equal to the given vector
 void djinn::Particle::getVelocity(djinn::Vec3 *velocity) {
-    *velocity = Particle::vel;
+    *velocity = this->velocity();
 }
 
 // Set the acceleration given a vector
 void djinn::Particle::setAcceleration(const djinn::Vec3 &acc) {
-    Particle::acc = acc;
+    acceleration() = acc;
 }
 
 void djinn::Particle::setAcceleration(const djinn::real x, const djinn::real y, const djinn::real z) {
-    acc.x = x;
-    acc.y = y;
-    acc.z = z;
+    djinn::Vec3 &target = acceleration();
+    target.x = x;
+    target.y = y;
+    target.z = z;
 }
 
 djinn::Vec3 djinn::Particle::getAcceleration() const {
-    return acc;
+    return acceleration();
 }
 
 djinn::real djinn::Particle::getMass() const {
-    if (inverseMass == 0) {
+    djinn::real inverse = inverseMassRef();
+    if (inverse == 0) {
 #ifdef DOUBLE_PRECISION
         return std::numeric_limits<double>::max();
 #else
         return std::numeric_limits<float>::max();
 #endif
     } else {
-        return ((real)1.0) / inverseMass;
+        return ((real)1.0) / inverse;
     }
 }
 
 djinn::real djinn::Particle::getInverseMass() const {
-    return inverseMass;
+    return inverseMassRef();
 }
 
 void djinn::Particle::clearNetForce() {
-    netForce.clear();
+    force().clear();
 }
 
 void djinn::Particle::addForce(const Vec3 &f) {
-    netForce += f;
+    force() += f;
+
+    // A zero force (e.g. from a registry that visits every particle) leaves a sleeper asleep
+    if (f.x != 0 || f.y != 0 || f.z != 0)
+        isAwake = true;
 }
 
 void djinn::Particle::clearNetPotential() {
@@ -157,9 +209,27 @@ void djinn::Particle::addPotential(const djinn::real potential) {
 }
 
 bool djinn::Particle::hasFiniteMass() const {
-    return inverseMass > 0.0;
+    return inverseMassRef() > 0.0;
+}
+
+void djinn::Particle::setAwake(const bool awake) {
+    if (awake) {
+        isAwake = true;
+    } else {
+        isAwake = false;
+        velocity().clear();
+        acceleration().clear();
+        force().clear();
+    }
+}
+
+void djinn::Particle::setCanSleep(const bool canSleep) {
+    this->canSleep = canSleep;
+
+    if (!canSleep && !isAwake)
+        setAwake();
 }
 
 djinn::Vec3 djinn::Particle::getNetForce() const {
-    return netForce;
+    return force();
 }
@@ -0,0 +1,246 @@
+/**
+ * @file pcollide.cpp
+ * @brief Define methods for particle-particle collision detection
+ * @author Catyre
+ */
+
+#include "djinn/pcollide.h"
+#include "djinn/parallel.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+
+void djinn::SpatialHash::build(const djinn::Vec3 *positions, unsigned count, djinn::real cellSize) {
+    assert(cellSize > 0);
+
+    this->cellSize = cellSize;
+    inverseCellSize = 1 / cellSize;
+
+    // About two buckets per point keeps the chains short
+    unsigned buckets = 1;
+    while (buckets < 2 * count)
+        buckets <<= 1;
+    mask = buckets - 1;
+
+    bucketStart.assign(buckets + 1, 0);
+    bucketOf.resize(count);
+    cells.resize(3 * count);
+    sorted.resize(count);
+
+    // Counting sort of the points by bucket
+    for (unsigned i = 0; i < count; i++) {
+        int *c = &cells[3 * i];
+        c[0] = static_cast<int>(std::floor(positions[i].x * inverseCellSize));
+        c[1] = static_cast<int>(std::floor(positions[i].y * inverseCellSize));
+        c[2] = static_cast<int>(std::floor(positions[i].z * inverseCellSize));
+
+        bucketOf[i] = bucket(c[0], c[1], c[2]);
+        bucketStart[bucketOf[i] + 1]++;
+    }
+
+    for (unsigned b = 0; b < buckets; b++) {
+        bucketStart[b + 1] += bucketStart[b];
+    }
+
+    std::vector<unsigned> cursor(bucketStart.begin(), bucketStart.end() - 1);
+    for (unsigned i = 0; i < count; i++) {
+        sorted[cursor[bucketOf[i]]++] = i;
+    }
+}
+
+unsigned djinn::SpatialHash::neighbourBuckets(unsigned i, unsigned *out) const {
+    const int *c = &cells[3 * i];
+
+    unsigned n = 0;
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                out[n++] = bucket(c[0] + dx, c[1] + dy, c[2] + dz);
+            }
+        }
+    }
+
+    // Neighbouring cells can hash to the same bucket
+    std::sort(out, out + n);
+    return static_cast<unsigned>(std::unique(out, out + n) - out);
+}
+
+void djinn::ParticleCollisions::add(djinn::Particle *particle, djinn::real radius) {
+    assert(radius > 0);
+
+    // Don't add duplicates
+    if (std::find(particles.begin(), particles.end(), particle) != particles.end()) {
+        spdlog::info("Particle \"{}\" already in collision generator...discarding", particle->getName());
+        return;
+    }
+
+    particles.push_back(particle);
+    radii.push_back(radius);
+
+    // Log registration
+    spdlog::info("Added particle \"{}\" to collision generator (radius {})", particle->getName(), radius);
+}
+
+void djinn::ParticleCollisions::remove(djinn::Particle *particle) {
+    for (unsigned i = 0; i < particles.size(); i++) {
+        if (particles[i] == particle) {
+            particles.erase(particles.begin() + i);
+            radii.erase(radii.begin() + i);
+            return;
+        }
+    }
+}
+
+void djinn::ParticleCollisions::clear() {
+    particles.clear();
+    radii.clear();
+}
+
+unsigned djinn::ParticleCollisions::addContact(djinn::ParticleContact *contact, unsigned limit) const {
+    unsigned count = static_cast<unsigned>(particles.size());
+    if (count < 2 || limit == 0)
+        return 0;
+
+    positions.resize(count);
+    djinn::real maxRadius = 0;
+    for (unsigned i = 0; i < count; i++) {
+        positions[i] = particles[i]->getPosition();
+        maxRadius = std::max(maxRadius, radii[i]);
+    }
+
+    // Overlapping spheres are at most two of the largest radii apart
+    grid.build(positions.data(), count, std::max(cellSize, 2 * maxRadius));
+
+    // Each block of particles collects the contacts it owns (those with a later
+    // particle), then the blocks are joined in order
+    unsigned blocks = djinn::getThreadCount();
+    blockContacts.resize(blocks);
+    for (std::vector<djinn::ParticleContact> &found : blockContacts) {
+        found.clear();
+    }
+
+    djinn::parallelFor(count, blocks, [&](unsigned begin, unsigned end, unsigned block) {
+        std::vector<djinn::ParticleContact> &found = blockContacts[block];
+
+        unsigned buckets[27];
+        for (unsigned i = begin; i < end && found.size() < limit; i++) {
+            const djinn::Vec3 &pi = positions[i];
+            unsigned numBuckets = grid.neighbourBuckets(i, buckets);
+
+            for (unsigned n = 0; n < numBuckets; n++) {
+                for (unsigned k = grid.bucketBegin(buckets[n]); k < grid.bucketEnd(buckets[n]); k++) {
+                    unsigned j = grid.point(k);
+                    if (j <= i)
+                        continue;
+
+                    // Two sleeping particles stay as they are
+                    if (!particles[i]->getAwake() && !particles[j]->getAwake())
+                        continue;
+
+                    djinn::Vec3 r = pi - positions[j];
+                    djinn::real reach = radii[i] + radii[j];
+                    djinn::real dSq = r.squareMagnitude();
+                    if (dSq >= reach * reach)
+                        continue;
+
+                    djinn::real d = real_sqrt(dSq);
+
+                    djinn::ParticleContact c;
+                    c.particles[0] = particles[i];
+                    c.particles[1] = particles[j];
+                    // Coincident particles get pushed apart along an arbitrary axis
+                    c.contactNormal = (d > 0) ? r * (1 / d) : djinn::Vec3(0, 1, 0);
+                    c.penetration = reach - d;
+                    c.restitution = restitution;
+                    found.push_back(c);
+                }
+            }
+        }
+    });
+
+    unsigned used = 0;
+    for (unsigned b = 0; b < blocks && used < limit; b++) {
+        unsigned n = std::min(static_cast<unsigned>(blockContacts[b].size()), limit - used);
+        std::copy(blockContacts[b].begin(), blockContacts[b].begin() + n, contact + used);
+        used += n;
+    }
+
+    return used;
+}
+
+void djinn::StaticContacts::add(djinn::Particle *particle, djinn::real radius) {
+    assert(radius >= 0);
+
+    // Don't add duplicates
+    if (std::find(particles.begin(), particles.end(), particle) != particles.end()) {
+        spdlog::info("Particle \"{}\" already in static contact generator...discarding", particle->getName());
+        return;
+    }
+
+    particles.push_back(particle);
+    radii.push_back(radius);
+
+    // Log registration
+    spdlog::info("Added particle \"{}\" to static contact generator (radius {})", particle->getName(), radius);
+}
+
+void djinn::StaticContacts::remove(djinn::Particle *particle) {
+    for (unsigned i = 0; i < particles.size(); i++) {
+        if (particles[i] == particle) {
+            particles.erase(particles.begin() + i);
+            radii.erase(radii.begin() + i);
+            return;
+        }
+    }
+}
+
+void djinn::StaticContacts::clear() {
+    particles.clear();
+    radii.clear();
+}
+
+unsigned djinn::StaticContacts::addContact(djinn::ParticleContact *contact, unsigned limit) const {
+    unsigned count = static_cast<unsigned>(particles.size());
+    if (!collider || count == 0 || limit == 0)
+        return 0;
+
+    // Each block of particles collects its own contacts, then the blocks are joined in order
+    unsigned blocks = djinn::getThreadCount();
+    blockContacts.resize(blocks);
+    for (std::vector<djinn::ParticleContact> &found : blockContacts) {
+        found.clear();
+    }
+
+    djinn::parallelFor(count, blocks, [&](unsigned begin, unsigned end, unsigned block) {
+        std::vector<djinn::ParticleContact> &found = blockContacts[block];
+
+        for (unsigned i = begin; i < end && found.size() < limit; i++) {
+            djinn::Particle *p = particles[i];
+            if (!p->getAwake())
+                continue;
+
+            djinn::real depth;
+            djinn::Vec3 normal;
+            if (!collider->penetration(p->getPosition(), radii[i], depth, normal))
+                continue;
+
+            djinn::ParticleContact c;
+            c.particles[0] = p;
+            c.particles[1] = nullptr;
+            c.contactNormal = normal;
+            c.penetration = depth;
+            c.restitution = restitution;
+            found.push_back(c);
+        }
+    });
+
+    unsigned used = 0;
+    for (unsigned b = 0; b < blocks && used < limit; b++) {
+        unsigned n = std::min(static_cast<unsigned>(blockContacts[b].size()), limit - used);
+        std::copy(blockContacts[b].begin(), blockContacts[b].begin() + n, contact + used);
+        used += n;
+    }
+
+    return used;
+}
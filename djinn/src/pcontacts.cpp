@@ -5,6 +5,10 @@
 */
 
 #include "djinn/pcontacts.h"
+#include "djinn/parallel.h"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
 
 void djinn::ParticleContact::resolve(djinn::real duration) {
     resolveVelocity(duration);
@@ -20,32 +24,38 @@ djinn::real djinn::ParticleContact::calculateSeparatingVelocity() const {
 void djinn::ParticleContact::resolveVelocity(djinn::real duration) {
     // Find the velocity in the direction of the contact
     djinn::real separatingVelocity = calculateSeparatingVelocity();
+    if (initialSeparatingVelocity == REAL_MAX)
+        initialSeparatingVelocity = separatingVelocity;
 
-    // Check if it needs to be resolved
-    if (separatingVelocity > 0) {
-        // The contact is either separating, or stationary - there's
-        // no impulse required.
-        return;
-    }
-
-    // Calculate the new separating velocity
-    djinn::real newSepVelocity = -separatingVelocity * restitution;
+    // The separating velocity to aim for is fixed by how fast the contact was
+    // closing at the start, so resolving it again (or after a warm start)
+    // only corrects towards the same bounce instead of cancelling it
+    djinn::real targetVelocity = 0;
+    if (initialSeparatingVelocity < 0) {
+        // Calculate the new separating velocity
+        targetVelocity = -initialSeparatingVelocity * restitution;
 
-    // Check the velocity buildup due to acceleration only.
-    djinn::Vec3 accCausedVelocity = particles[0]->getAcceleration();
-    if (particles[1]) accCausedVelocity -= particles[1]->getAcceleration();
-    djinn::real accCausedSepVelocity = accCausedVelocity * contactNormal * duration;
+        // Check the velocity buildup due to acceleration only.
+        djinn::Vec3 accCausedVelocity = particles[0]->getAcceleration();
+        if (particles[1]) accCausedVelocity -= particles[1]->getAcceleration();
+        djinn::real accCausedSepVelocity = accCausedVelocity * contactNormal * duration;
 
-    // If we’ve got a closing velocity due to aceleration buildup,
-    // remove it from the new separating velocity.
-    if (accCausedSepVelocity < 0) {
-        newSepVelocity += restitution * accCausedSepVelocity;
-        // Make sure we haven’t removed more than was
-        // there to remove.
-        if (newSepVelocity < 0) newSepVelocity = 0;
+        // If we’ve got a closing velocity due to aceleration buildup,
+        // remove it from the new separating velocity.
+        if (accCausedSepVelocity < 0) {
+            targetVelocity += restitution * accCausedSepVelocity;
+            // Make sure we haven’t removed more than was
+            // there to remove.
+            if (targetVelocity < 0) targetVelocity = 0;
+        }
     }
 
-    real deltaVelocity = newSepVelocity - separatingVelocity;
+    // Check if it needs to be resolved: a contact separating at least as fast
+    // as it should needs no impulse, unless a warm start pushed it apart
+    // harder than needed, in which case some of that is taken back
+    if (separatingVelocity >= targetVelocity && accumulatedImpulse <= 0) return;
+
+    djinn::real deltaVelocity = targetVelocity - separatingVelocity;
 
     // We apply the change in velocity to each object in proportion to
     // their inverse mass (i.e. those with lower inverse mass [higher
@@ -56,8 +66,11 @@ void djinn::ParticleContact::resolveVelocity(djinn::real duration) {
     // If all particles have infinite mass, then impulses have no effect
     if (totalInverseMass <= 0) return;
 
-    // Calculate the impulse to apply
+    // Calculate the impulse to apply. A contact can only push, so it never
+    // takes back more than it has applied so far.
     djinn::real impulse = deltaVelocity / totalInverseMass;
+    if (impulse < -accumulatedImpulse) impulse = -accumulatedImpulse;
+    accumulatedImpulse += impulse;
 
     // Find the amount of impulse per unit of inverse mass
     djinn::Vec3 impulsePerIMass = contactNormal * impulse;
@@ -73,6 +86,10 @@ void djinn::ParticleContact::resolveVelocity(djinn::real duration) {
 } // void ParticleContact::resolveVelocity
 
 void djinn::ParticleContact::resolveInterpenetration(djinn::real duration) {
+    // Nothing moves unless there is penetration to resolve (the resolver reads the movement afterwards)
+    particleMovement[0].clear();
+    particleMovement[1].clear();
+
     // If we don't have any penetration, skip this step
     if (penetration <= 0) return;
 
@@ -111,7 +128,68 @@ void djinn::ParticleContactResolver::setIterations(unsigned iterations) {
     djinn::ParticleContactResolver::iterations = iterations;
 } // void ParticleContactResolver::setIterations
 
+void djinn::ParticleContactResolver::useContactHeap() {
+    mode = CONTACT_HEAP;
+}
+
+void djinn::ParticleContactResolver::useLinearScan() {
+    mode = LINEAR_SCAN;
+}
+
+void djinn::ParticleContactResolver::useGraphColoring(unsigned sweeps) {
+    mode = GRAPH_COLORING;
+    this->sweeps = sweeps;
+}
+
 void djinn::ParticleContactResolver::resolveContacts(djinn::ParticleContact *particleArray, unsigned numContacts, djinn::real duration) {
+    switch (mode) {
+        case CONTACT_HEAP:
+            resolveWithHeap(particleArray, numContacts, duration);
+            break;
+        case GRAPH_COLORING:
+            resolveColored(particleArray, numContacts, duration);
+            break;
+        default:
+            resolveLinear(particleArray, numContacts, duration);
+            break;
+    }
+} // void ParticleContactResolver::resolveContacts
+
+void djinn::ParticleContactResolver::setTolerance(djinn::real velocityTolerance, djinn::real penetrationTolerance) {
+    this->velocityTolerance = velocityTolerance;
+    this->penetrationTolerance = penetrationTolerance;
+}
+
+djinn::real djinn::ParticleContactResolver::contactKey(const djinn::ParticleContact &contact) const {
+    djinn::real sepVel = contact.calculateSeparatingVelocity();
+
+    // Contacts that are already separating are left alone; resolving them
+    // again could only take back the impulse that made them bounce
+    if (sepVel < -velocityTolerance || contact.penetration > penetrationTolerance)
+        return sepVel;
+
+    return REAL_MAX;
+}
+
+void djinn::ParticleContactResolver::updatePenetration(djinn::ParticleContact &contact, const djinn::ParticleContact &resolved) {
+    const djinn::Vec3 *move = resolved.particleMovement;
+
+    if (contact.particles[0] == resolved.particles[0]) {
+        contact.penetration -= move[0] * contact.contactNormal;
+    } else if (contact.particles[0] == resolved.particles[1]) {
+        contact.penetration -= move[1] * contact.contactNormal;
+    }
+
+    if (contact.particles[1]) {
+        if (contact.particles[1] == resolved.particles[0]) {
+            contact.penetration += move[0] * contact.contactNormal;
+        } else if (contact.particles[1] == resolved.particles[1]) {
+            contact.penetration += move[1] * contact.contactNormal;
+        }
+    }
+}
+
+void djinn::ParticleContactResolver::resolveLinear(djinn::ParticleContact *particleArray, unsigned numContacts, djinn::real duration) {
     unsigned i;
 
     iterationsUsed = 0;
@@ -120,8 +198,8 @@ void djinn::ParticleContactResolver::resolveContacts(djinn::ParticleContact *par
         djinn::real max = REAL_MAX;
         unsigned maxIndex = numContacts;
         for (i = 0; i < numContacts; i++) {
-            djinn::real sepVel = particleArray[i].calculateSeparatingVelocity();
-            if (sepVel < max && (sepVel < 0 || particleArray[i].penetration > 0)) {
+            djinn::real sepVel = contactKey(particleArray[i]);
+            if (sepVel < max) {
                 max = sepVel;
                 maxIndex = i;
             }
@@ -134,23 +212,346 @@ void djinn::ParticleContactResolver::resolveContacts(djinn::ParticleContact *par
         particleArray[maxIndex].resolve(duration);
 
         // Update the interpenetrations for all particles
-        djinn::Vec3 *move = particleArray[maxIndex].particleMovement;
         for (i = 0; i < numContacts; i++) {
-            if (particleArray[i].particles[0] == particleArray[maxIndex].particles[0]) {
-                particleArray[i].penetration -= move[0] * particleArray[i].contactNormal;
-            } else if (particleArray[i].particles[0] == particleArray[maxIndex].particles[1]) {
-                particleArray[i].penetration -= move[1] * particleArray[i].contactNormal;
+            updatePenetration(particleArray[i], particleArray[maxIndex]);
+        }
+
+        iterationsUsed++;
+    }
+} // void ParticleContactResolver::resolveLinear
+
+void djinn::ParticleContactResolver::buildAdjacency(const djinn::ParticleContact *particleArray, unsigned numContacts) {
+    // One (particle, contact slot) entry per contact end, sorted so each particle's entries are adjacent
+    std::vector<std::pair<djinn::Particle *, unsigned>> ends;
+    ends.reserve(2 * numContacts);
+    for (unsigned c = 0; c < numContacts; c++) {
+        for (unsigned s = 0; s < 2; s++) {
+            if (particleArray[c].particles[s])
+                ends.push_back(std::make_pair(particleArray[c].particles[s], 2 * c + s));
+        }
+    }
+
+    std::sort(ends.begin(), ends.end(), [](const std::pair<djinn::Particle *, unsigned> &a,
+                                           const std::pair<djinn::Particle *, unsigned> &b) {
+        return std::less<djinn::Particle *>()(a.first, b.first) || (a.first == b.first && a.second < b.second);
+    });
+
+    adjacentContacts.resize(ends.size());
+    firstAdjacent.assign(2 * numContacts, 0);
+    lastAdjacent.assign(2 * numContacts, 0);
+
+    unsigned runStart = 0;
+    for (unsigned k = 0; k < ends.size(); k++) {
+        adjacentContacts[k] = ends[k].second / 2;
+
+        // At the end of a particle's run, point every end in the run at it
+        if (k + 1 == ends.size() || ends[k + 1].first != ends[k].first) {
+            for (unsigned r = runStart; r <= k; r++) {
+                firstAdjacent[ends[r].second] = runStart;
+                lastAdjacent[ends[r].second] = k + 1;
+            }
+            runStart = k + 1;
+        }
+    }
+}
+
+void djinn::ParticleContactResolver::resolveWithHeap(djinn::ParticleContact *particleArray, unsigned numContacts, djinn::real duration) {
+    iterationsUsed = 0;
+    if (numContacts == 0)
+        return;
+
+    buildAdjacency(particleArray, numContacts);
+
+    keys.resize(numContacts);
+    for (unsigned c = 0; c < numContacts; c++) {
+        keys[c] = contactKey(particleArray[c]);
+    }
+    heap.build(keys.data(), numContacts);
+    visited.assign(numContacts, 0);
+
+    while (iterationsUsed < iterations) {
+        // Do we have anything worth resolving?
+        if (heap.topKey() == REAL_MAX) break;
+
+        // Resolve the contact with the largest closing velocity
+        unsigned resolved = heap.top();
+        particleArray[resolved].resolve(duration);
+        iterationsUsed++;
+
+        // Only contacts sharing a particle with the resolved one have changed, in
+        // penetration or in separating velocity
+        for (unsigned s = 0; s < 2; s++) {
+            if (!particleArray[resolved].particles[s])
+                continue;
+
+            unsigned end = 2 * resolved + s;
+            for (unsigned k = firstAdjacent[end]; k < lastAdjacent[end]; k++) {
+                unsigned c = adjacentContacts[k];
+                if (visited[c] == iterationsUsed)
+                    continue;
+                visited[c] = iterationsUsed;
+
+                updatePenetration(particleArray[c], particleArray[resolved]);
+                heap.update(c, contactKey(particleArray[c]));
+            }
+        }
+    }
+} // void ParticleContactResolver::resolveWithHeap
+
+void djinn::ParticleContactResolver::updateAdjacent(djinn::ParticleContact *particleArray, unsigned resolved, unsigned stamp) {
+    for (unsigned s = 0; s < 2; s++) {
+        if (!particleArray[resolved].particles[s])
+            continue;
+
+        unsigned end = 2 * resolved + s;
+        for (unsigned k = firstAdjacent[end]; k < lastAdjacent[end]; k++) {
+            unsigned c = adjacentContacts[k];
+            if (visited[c] == stamp)
+                continue;
+            visited[c] = stamp;
+
+            updatePenetration(particleArray[c], particleArray[resolved]);
+        }
+    }
+}
+
+void djinn::ParticleContactResolver::colorContacts(unsigned numContacts) {
+    // Colors already taken at each particle, one bit per color, indexed by the
+    // particle's first entry in adjacentContacts. Contacts that find all 64
+    // colors taken go into a last batch that is resolved serially.
+    const unsigned SERIAL = 64;
+    std::vector<uint64_t> taken(adjacentContacts.size(), 0);
+    std::vector<unsigned> colors(numContacts);
+
+    colorStart.assign(SERIAL + 2, 0);
+
+    for (unsigned c = 0; c < numContacts; c++) {
+        uint64_t used = 0;
+        for (unsigned s = 0; s < 2; s++) {
+            if (firstAdjacent[2 * c + s] < lastAdjacent[2 * c + s])
+                used |= taken[firstAdjacent[2 * c + s]];
+        }
+
+        unsigned color = SERIAL;
+        if (~used) {
+            color = 0;
+            while (used & (uint64_t(1) << color))
+                color++;
+
+            for (unsigned s = 0; s < 2; s++) {
+                if (firstAdjacent[2 * c + s] < lastAdjacent[2 * c + s])
+                    taken[firstAdjacent[2 * c + s]] |= uint64_t(1) << color;
+            }
+        }
+
+        colors[c] = color;
+        colorStart[color + 1]++;
+    }
+
+    // Counting sort of the contacts by color, keeping index order within each color
+    for (unsigned k = 0; k <= SERIAL; k++) {
+        colorStart[k + 1] += colorStart[k];
+    }
+
+    colorOrder.resize(numContacts);
+    std::vector<unsigned> cursor(colorStart.begin(), colorStart.end() - 1);
+    for (unsigned c = 0; c < numContacts; c++) {
+        colorOrder[cursor[colors[c]]++] = c;
+    }
+}
+
+void djinn::ParticleContactResolver::resolveColored(djinn::ParticleContact *particleArray, unsigned numContacts, djinn::real duration) {
+    iterationsUsed = 0;
+    if (numContacts == 0)
+        return;
+
+    buildAdjacency(particleArray, numContacts);
+    colorContacts(numContacts);
+
+    visited.assign(numContacts, 0);
+    resolvedInBatch.assign(numContacts, 0);
+    unsigned stamp = 0;
+
+    const unsigned colorCount = static_cast<unsigned>(colorStart.size()) - 1;
+    const unsigned serialColor = colorCount - 1;
+
+    for (unsigned sweep = 0; sweep < sweeps; sweep++) {
+        unsigned resolvedThisSweep = 0;
+
+        for (unsigned color = 0; color < colorCount; color++) {
+            unsigned first = colorStart[color];
+            unsigned count = colorStart[color + 1] - first;
+            if (count == 0)
+                continue;
+
+            // No two contacts of a color share a particle, so they can be resolved at once
+            auto resolveRange = [&](unsigned begin, unsigned end, unsigned) {
+                for (unsigned k = begin; k < end; k++) {
+                    unsigned c = colorOrder[first + k];
+                    resolvedInBatch[c] = contactKey(particleArray[c]) != REAL_MAX;
+                    if (resolvedInBatch[c])
+                        particleArray[c].resolve(duration);
+                }
+            };
+
+            if (color == serialColor) {
+                // Overflow contacts may share particles, so they also update penetrations one by one
+                for (unsigned k = 0; k < count; k++) {
+                    unsigned c = colorOrder[first + k];
+                    resolveRange(k, k + 1, 0);
+                    if (resolvedInBatch[c]) {
+                        updateAdjacent(particleArray, c, ++stamp);
+                        resolvedThisSweep++;
+                    }
+                }
+                continue;
             }
 
-            if (particleArray[i].particles[1]) {
-                if (particleArray[i].particles[1] == particleArray[maxIndex].particles[0]) {
-                    particleArray[i].penetration += move[0] * particleArray[i].contactNormal;
-                } else if (particleArray[i].particles[1] == particleArray[maxIndex].particles[1]) {
-                    particleArray[i].penetration += move[1] * particleArray[i].contactNormal;
+            djinn::parallelFor(count, resolveRange);
+
+            // Moving a particle changes the penetration of every contact it is in
+            for (unsigned k = 0; k < count; k++) {
+                unsigned c = colorOrder[first + k];
+                if (resolvedInBatch[c]) {
+                    updateAdjacent(particleArray, c, ++stamp);
+                    resolvedThisSweep++;
                 }
             }
         }
 
-        iterationsUsed++;
+        iterationsUsed += resolvedThisSweep;
+
+        // Everything is separating and resolved
+        if (resolvedThisSweep == 0)
+            break;
+    }
+} // void ParticleContactResolver::resolveColored
+
+void djinn::IndexedHeap::build(const djinn::real *keys, unsigned count) {
+    this->keys.assign(keys, keys + count);
+    heap.resize(count);
+    slot.resize(count);
+
+    for (unsigned i = 0; i < count; i++) {
+        heap[i] = i;
+        slot[i] = i;
+    }
+
+    for (unsigned i = count / 2; i-- > 0;) {
+        siftDown(i);
+    }
+}
+
+void djinn::IndexedHeap::update(unsigned index, djinn::real key) {
+    keys[index] = key;
+    siftUp(slot[index]);
+    siftDown(slot[index]);
+}
+
+void djinn::IndexedHeap::swap(unsigned i, unsigned j) {
+    std::swap(heap[i], heap[j]);
+    slot[heap[i]] = i;
+    slot[heap[j]] = j;
+}
+
+void djinn::IndexedHeap::siftUp(unsigned i) {
+    while (i > 0) {
+        unsigned parent = (i - 1) / 2;
+        if (!less(heap[i], heap[parent]))
+            return;
+
+        swap(i, parent);
+        i = parent;
+    }
+}
+
+void djinn::IndexedHeap::siftDown(unsigned i) {
+    unsigned count = static_cast<unsigned>(heap.size());
+
+    while (true) {
+        unsigned smallest = i;
+        unsigned left = 2 * i + 1;
+        unsigned right = left + 1;
+
+        if (left < count && less(heap[left], heap[smallest]))
+            smallest = left;
+        if (right < count && less(heap[right], heap[smallest]))
+            smallest = right;
+
+        if (smallest == i)
+            return;
+
+        swap(i, smallest);
+        i = smallest;
+    }
+}
+
+djinn::ContactCache::Key djinn::ContactCache::makeKey(const djinn::ParticleContact &contact, bool &flipped) {
+    Key key;
+    key.a = contact.particles[0];
+    key.b = contact.particles[1];
+
+    // Scenery contacts keep the particle first; particle pairs go in address order
+    flipped = key.b && std::less<const djinn::Particle *>()(key.b, key.a);
+    if (flipped)
+        std::swap(key.a, key.b);
+
+    return key;
+}
+
+void djinn::ContactCache::warmStart(djinn::ParticleContact *contacts, unsigned numContacts) {
+    for (unsigned c = 0; c < numContacts; c++) {
+        djinn::ParticleContact &contact = contacts[c];
+        contact.accumulatedImpulse = 0;
+        contact.initialSeparatingVelocity = contact.calculateSeparatingVelocity();
+
+        bool flipped;
+        auto found = entries.find(makeKey(contact, flipped));
+        if (found == entries.end())
+            continue;
+
+        // Leave contacts that are already coming apart alone
+        if (contact.initialSeparatingVelocity > 0)
+            continue;
+
+        djinn::real totalInverseMass = contact.particles[0]->getInverseMass();
+        if (contact.particles[1]) totalInverseMass += contact.particles[1]->getInverseMass();
+        if (totalInverseMass <= 0)
+            continue;
+
+        // Only the part of the old impulse along the new normal carries over
+        djinn::Vec3 oldNormal = flipped ? found->second.normal * -1.0 : found->second.normal;
+        djinn::real alignment = oldNormal * contact.contactNormal;
+        if (alignment <= 0)
+            continue;
+
+        djinn::real impulse = found->second.impulse * alignment * warmStartFactor;
+        djinn::Vec3 impulsePerIMass = contact.contactNormal * impulse;
+
+        contact.particles[0]->setVelocity(contact.particles[0]->getVelocity() + impulsePerIMass * contact.particles[0]->getInverseMass());
+        if (contact.particles[1])
+            contact.particles[1]->setVelocity(contact.particles[1]->getVelocity() + impulsePerIMass * -contact.particles[1]->getInverseMass());
+
+        contact.accumulatedImpulse = impulse;
+    }
+}
+
+void djinn::ContactCache::store(const djinn::ParticleContact *contacts, unsigned numContacts) {
+    frame++;
+
+    for (unsigned c = 0; c < numContacts; c++) {
+        bool flipped;
+        Entry &entry = entries[makeKey(contacts[c], flipped)];
+        entry.normal = flipped ? contacts[c].contactNormal * -1.0 : contacts[c].contactNormal;
+        entry.impulse = contacts[c].accumulatedImpulse;
+        entry.frame = frame;
+    }
+
+    // Pairs that were not in contact this frame start from nothing next time
+    for (auto entry = entries.begin(); entry != entries.end();) {
+        if (entry->second.frame != frame)
+            entry = entries.erase(entry);
+        else
+            entry++;
     }
-} // void ParticleContactResolver::resolveContacts
\ No newline at end of file
+}
@@ -20,9 +20,13 @@
 #define G 6.67408e-11 // [m^3 kg^-1 s^-2]
 
 #include "djinn/pfgen.h"
+#include "djinn/parallel.h"
 #include "spdlog/spdlog.h"
 #include <algorithm>
+#include <assert.h>
 #include <iostream>
+#include <unordered_map>
+#include <unordered_set>
 
 void djinn::ParticleUniversalForceRegistry::add(djinn::Particle *particle) {
     ParticleUniversalForceRegistration registration;
@@ -70,25 +74,101 @@ void djinn::ParticleUniversalForceRegistry::remove(djinn::Particle *particle) {
     }
 }
 
+void djinn::ParticleUniversalForceRegistry::useBarnesHut(djinn::real theta) {
+    assert(theta >= 0);
+    barnesHut = true;
+    this->theta = theta;
+
+    spdlog::info("Universal force registry using Barnes-Hut gravity (theta = {})", theta);
+}
+
+void djinn::ParticleUniversalForceRegistry::useDirectSummation() {
+    barnesHut = false;
+    tree.clear();
+
+    spdlog::info("Universal force registry using direct gravity summation");
+}
+
 void djinn::ParticleUniversalForceRegistry::applyGravity() {
-    for (Registry::iterator i = registrations.begin(); i != registrations.end(); i++) {
-        for (Registry::iterator j = registrations.begin(); j != registrations.end(); j++) {
-            if (i->particle != j->particle) {
+    if (barnesHut)
+        applyGravityBarnesHut();
+    else
+        applyGravityDirect();
+}
+
+void djinn::ParticleUniversalForceRegistry::gatherBodies() {
+    unsigned count = static_cast<unsigned>(registrations.size());
+
+    positions.resize(count);
+    masses.resize(count);
+    forces.resize(count);
+    for (unsigned i = 0; i < count; i++) {
+        positions[i] = registrations[i].particle->getPosition();
+        masses[i] = registrations[i].particle->getMass();
+    }
+}
+
+void djinn::ParticleUniversalForceRegistry::applyGravityBarnesHut() {
+    unsigned count = static_cast<unsigned>(registrations.size());
+
+    // Gather the registered bodies into flat arrays and rebuild the tree over them
+    gatherBodies();
+    tree.build(positions.data(), masses.data(), count);
+
+    // Every body walks the tree on its own, so the bodies can be split across threads
+    djinn::parallelFor(count, [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned i = begin; i < end; i++) {
+            forces[i] = tree.field(i, theta) * (-G * masses[i]);
+        }
+    });
+
+    // Sleeping bodies stay put, like in the force registry
+    for (unsigned i = 0; i < count; i++) {
+        if (registrations[i].particle->getAwake())
+            registrations[i].particle->addForce(forces[i]);
+    }
+
+    // Log force application (once per step; per-pair logging doesn't scale to large N)
+    spdlog::info("Applied Barnes-Hut gravitational force to {} particles ({} octree nodes)", count, tree.nodeCount());
+}
+
+void djinn::ParticleUniversalForceRegistry::applyGravityDirect() {
+    unsigned count = static_cast<unsigned>(registrations.size());
+    gatherBodies();
+
+    // Each body sums the pull of all the others into its own entry, so the bodies
+    // can be split across threads without sharing any writes
+    djinn::parallelFor(count, [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned i = begin; i < end; i++) {
+            djinn::Vec3 force;
+
+            for (unsigned j = 0; j < count; j++) {
+                if (registrations[i].particle == registrations[j].particle)
+                    continue;
+
                 // Calculate radius between the two bodies
-                djinn::Vec3 r = i->particle->getPosition() - j->particle->getPosition();
+                djinn::Vec3 r = positions[i] - positions[j];
 
                 // Square magnitude
                 djinn::real rMagSquared = r.squareMagnitude();
 
                 // Normalize radius vector (to only use direction)
                 r = r.normalize();
-                djinn::Vec3 force = r * (-G * i->particle->getMass() * j->particle->getMass()) / (rMagSquared);
-                i->particle->addForce(force);
-
-                // Log force application
-                spdlog::info("Applied gravitational force from \"{}\" on \"{}\" ({} N)", j->particle->getName(), i->particle->getName(), force.toString());
+                force += r * (-G * masses[i] * masses[j]) / (rMagSquared);
             }
+
+            forces[i] = force;
         }
+    });
+
+    for (unsigned i = 0; i < count; i++) {
+        if (!registrations[i].particle->getAwake())
+            continue;
+
+        registrations[i].particle->addForce(forces[i]);
+
+        // Log force application
+        spdlog::info("Applied gravitational force on \"{}\" ({} N)", registrations[i].particle->getName(), forces[i].toString());
     }
 }
 
@@ -101,14 +181,101 @@ void djinn::ParticleUniversalForceRegistry::integrateAll(djinn::real duration) {
     }
 }
 
+void djinn::ParticleForceGenerator::updateForces(djinn::Particle **particles, unsigned count, djinn::real duration) {
+    for (unsigned i = 0; i < count; i++) {
+        updateForce(particles[i], duration);
+    }
+}
+
 void djinn::ParticleForceRegistry::updateForces(djinn::real duration) {
-    Registry::iterator i = registrations.begin();
+    if (dirty)
+        groupByGenerator();
 
-    for (; i != registrations.end(); i++) {
-        i->fg->updateForce(i->particle, duration);
+    for (unsigned g = 0; g < generators.size(); g++) {
+        djinn::ParticleForceGenerator *fg = generators[g];
+
+        // Sleeping particles feel nothing until something wakes them, such as the moving
+        //      other end of a spring, whose force (if any) wakes them through addForce()
+        const djinn::Particle *other = fg->getOther();
+        bool driven = other && other->getAwake() && other->hasFiniteMass();
+
+        batch.clear();
+        for (unsigned k = firstParticle[g]; k < firstParticle[g + 1]; k++) {
+            if (driven || grouped[k]->getAwake())
+                batch.push_back(grouped[k]);
+        }
+        if (batch.empty())
+            continue;
+
+        // Every particle of the store at once, straight from its arrays
+        djinn::ParticleStore *store = fg->hasStoreForces() ? batchStore() : nullptr;
+        if (store) {
+            djinn::parallelFor(store->size(), [&](unsigned begin, unsigned end, unsigned) {
+                fg->updateStoreForces(store, begin, end, duration);
+            });
+            continue;
+        }
+
+        // A particle appears at most once per generator and generators run one after another,
+        // so no two threads ever add force to the same particle
+        djinn::parallelFor(static_cast<unsigned>(batch.size()), [&](unsigned begin, unsigned end, unsigned) {
+            fg->updateForces(batch.data() + begin, end - begin, duration);
+        });
     }
 }
 
+djinn::ParticleStore *djinn::ParticleForceRegistry::batchStore() const {
+    djinn::ParticleStore *store = batch.front()->getStore();
+    if (!store || store->size() != batch.size())
+        return nullptr;
+
+    // A particle appears at most once per generator, so if all of them are bound to the store
+    //      they fill it
+    for (const djinn::Particle *p : batch) {
+        if (p->getStore() != store)
+            return nullptr;
+    }
+
+    return store;
+}
+
+void djinn::ParticleForceRegistry::groupByGenerator() {
+    unsigned count = static_cast<unsigned>(registrations.size());
+
+    // Number the generators in the order they were first added
+    std::unordered_map<djinn::ParticleForceGenerator *, unsigned> generatorIndex;
+    std::unordered_set<djinn::Particle *> seen;
+    std::vector<unsigned> group(count);
+    generators.clear();
+    uniqueParticles.clear();
+    for (unsigned k = 0; k < count; k++) {
+        auto inserted = generatorIndex.emplace(registrations[k].fg, static_cast<unsigned>(generators.size()));
+        if (inserted.second)
+            generators.push_back(registrations[k].fg);
+        group[k] = inserted.first->second;
+
+        if (seen.insert(registrations[k].particle).second)
+            uniqueParticles.push_back(registrations[k].particle);
+    }
+
+    // Counting sort by generator, keeping each generator's particles in the order they were added
+    firstParticle.assign(generators.size() + 1, 0);
+    for (unsigned k = 0; k < count; k++) {
+        firstParticle[group[k] + 1]++;
+    }
+    for (unsigned g = 0; g < generators.size(); g++) {
+        firstParticle[g + 1] += firstParticle[g];
+    }
+
+    grouped.resize(count);
+    std::vector<unsigned> cursor(firstParticle.begin(), firstParticle.end() - 1);
+    for (unsigned k = 0; k < count; k++) {
+        grouped[cursor[group[k]]++] = registrations[k].particle;
+    }
+
+    dirty = false;
+}
+
 void djinn::ParticleForceRegistry::add(djinn::Particle *particle, djinn::ParticleForceGenerator *fg) {
     ParticleForceRegistration registration;
     registration.particle = particle;
@@ -117,6 +284,7 @@ void djinn::ParticleForceRegistry::add(djinn::Particle *particle, djinn::Particl
     // Add to the list of registrations only if it's not already in it
     if (find(begin(registrations), end(registrations), registration) == end(registrations)) {
         registrations.push_back(registration);
+        dirty = true;
 
         // Log registration
         spdlog::info("Added particle \"{}\" to force registry", particle->getName());
@@ -127,10 +295,12 @@ void djinn::ParticleForceRegistry::add(djinn::Particle *particle, djinn::Particl
 }
 
 void djinn::ParticleForceRegistry::integrateAll(djinn::real duration) {
-    Registry::iterator i = registrations.begin();
+    // A particle with several generators has several registrations, but is only integrated once
+    if (dirty)
+        groupByGenerator();
 
-    for (; i != registrations.end(); i++) {
-        i->particle->integrate(duration);
+    for (djinn::Particle *particle : uniqueParticles) {
+        particle->integrate(duration);
     }
 }
 
@@ -140,6 +310,7 @@ void djinn::ParticleForceRegistry::remove(djinn::Particle *particle, djinn::Part
     for (; i != registrations.end(); i++) {
         if (i->particle == particle && i->fg == fg) {
             registrations.erase(i);
+            dirty = true;
             return;
         }
     }
@@ -147,6 +318,7 @@ void djinn::ParticleForceRegistry::remove(djinn::Particle *particle, djinn::Part
 
 void djinn::ParticleForceRegistry::clear() {
     registrations.clear();
+    dirty = true;
 }
 
 djinn::ParticleEarthGravity::ParticleEarthGravity(const djinn::Vec3 &gravity)
@@ -159,7 +331,7 @@ void djinn::ParticleEarthGravity::updateForce(djinn::Particle *particle, djinn::
         return;
 
     // Calculate force
-    djinn::Vec3 force = gravity * particle->getMass();
+    djinn::Vec3 force = calculateForce(particle);
 
     // Apply force to the particle
     particle->addForce(force);
@@ -167,6 +339,29 @@ void djinn::ParticleEarthGravity::updateForce(djinn::Particle *particle, djinn::
     spdlog::info("Applied Earth gravity to particle \"{}\" ({})", particle->getName(), force.toString());
 }
 
+void djinn::ParticleEarthGravity::updateForces(djinn::Particle **particles, unsigned count, djinn::real) {
+    for (unsigned i = 0; i < count; i++) {
+        if (particles[i]->hasFiniteMass())
+            particles[i]->addForce(calculateForce(particles[i]));
+    }
+
+    // Log force application (once per batch; per-particle logging doesn't scale)
+    spdlog::info("Applied Earth gravity to {} particles ({} m/s^2)", count, gravity.toString());
+}
+
+void djinn::ParticleEarthGravity::updateStoreForces(djinn::ParticleStore *store, unsigned begin, unsigned end, djinn::real) {
+    djinn::Vec3 *forces = store->getNetForces();
+    const djinn::real *inverseMasses = store->getInverseMasses();
+
+    // Every particle in the store is awake, so the force doesn't need addForce() to wake it
+    for (unsigned i = begin; i < end; i++) {
+        if (inverseMasses[i] > 0.0)
+            forces[i].addScaledVector(gravity, 1 / inverseMasses[i]);
+    }
+
+    spdlog::info("Applied Earth gravity to {} stored particles ({} m/s^2)", end - begin, gravity.toString());
+}
+
 djinn::ParticlePointGravity::ParticlePointGravity(const djinn::Vec3 &origin, const djinn::real mass)
     : origin(origin), mass(mass) {
 }
@@ -198,34 +393,46 @@ void djinn::ParticlePointGravity::updateForce(djinn::Particle *particle, djinn::
     spdlog::info("Applied fixed-point gravitational force to particle \"{}\" ({})", particle->getName(), force.toString());
 } // void djinn::ParticlePointGravity::updateForce
 
-void djinn::ParticleDrag::updateForce(djinn::Particle *particle, djinn::real duration) {
-    djinn::Vec3 force;
-    particle->getVelocity(&force);
-
-    // Calculate total drag coefficient
-    djinn::real dragCoeff = force.magnitude();
-    dragCoeff = k1 * dragCoeff + k2 * real_pow(dragCoeff, 2);
+djinn::ParticleDrag::ParticleDrag(djinn::real k1, djinn::real k2)
+    : k1(k1), k2(k2) {
+}
 
-    force.normalize();
-    force *= -dragCoeff;
+void djinn::ParticleDrag::updateForce(djinn::Particle *particle, djinn::real duration) {
+    djinn::Vec3 force = calculateForce(particle);
     particle->addForce(force);
 
     // Log force application
     spdlog::info("Applied drag force to particle \"{}\" ({})", particle->getName(), force.toString());
 } // void djinn::ParticleDrag::updateForce
 
+void djinn::ParticleDrag::updateForces(djinn::Particle **particles, unsigned count, djinn::real) {
+    for (unsigned i = 0; i < count; i++) {
+        particles[i]->addForce(calculateForce(particles[i]));
+    }
+
+    // Log force application (once per batch; per-particle logging doesn't scale)
+    spdlog::info("Applied drag force to {} particles", count);
+}
+
+void djinn::ParticleDrag::updateStoreForces(djinn::ParticleStore *store, unsigned begin, unsigned end, djinn::real) {
+    djinn::Vec3 *forces = store->getNetForces();
+    const djinn::Vec3 *velocities = store->getVelocities();
+
+    for (unsigned i = begin; i < end; i++) {
+        forces[i].addScaledVector(velocities[i], -(k1 + k2 * velocities[i].magnitude()));
+    }
+
+    spdlog::info("Applied drag force to {} stored particles", end - begin);
+}
+
 djinn::ParticleUplift::ParticleUplift(djinn::Vec3 origin, djinn::real radius)
     : origin(origin), radius(radius) {
 }
 
 void djinn::ParticleUplift::updateForce(djinn::Particle *particle, djinn::real duration) {
-    djinn::Vec3 force;
+    djinn::Vec3 force = calculateForce(particle);
 
-    djinn::real x = particle->getPosition().x;
-    djinn::real z = particle->getPosition().z;
-
-    if (real_pow((x - origin.x), 2) + real_pow((z - origin.z), 2) < real_pow(radius, 2)) {
-        force.y = 1.0; // Apply constant force in y-direction
+    if (force.y != 0) {
         particle->addForce(force);
 
         // Log force application
@@ -242,13 +449,13 @@ void djinn::ParticleSpring::updateForce(djinn::Particle *particle, djinn::real d
     djinn::Vec3 force = particle->getPosition();
     force -= other->getPosition();
 
-    // Calculate the magnitude of the force
+    // Calculate the magnitude of the force (negative when compressed, so the spring pushes)
     djinn::real magnitude = force.magnitude();
-    magnitude = real_abs(magnitude - restLength);
+    magnitude = magnitude - restLength;
     magnitude *= springConstant;
 
     // Calculate the final force and apply it
-    force.normalize();
+    force = force.normalize();
     force *= -magnitude;
     particle->addForce(force);
 
@@ -271,10 +478,10 @@ void djinn::ParticleAnchoredSpring::updateForce(djinn::Particle *particle, djinn
     djinn::real stretchedLength = force.magnitude();
 
     // Calculate the magnitude of the force
-    djinn::real magnitude = real_abs(stretchedLength - restLength) * springConstant;
+    djinn::real magnitude = (stretchedLength - restLength) * springConstant;
 
     // Calculate the final force and apply it
-    force.normalize();
+    force = force.normalize();
     force *= -magnitude;
 
     // If the spring is stretched too far, reduce its spring constant (and therefore the force) to a quarter
@@ -303,10 +510,10 @@ void djinn::ParticleBungee::updateForce(djinn::Particle *particle, djinn::real d
         return;
 
     // Calculate the magnitude of the force.
-    magnitude = springConstant * (restLength - magnitude);
+    magnitude = springConstant * (magnitude - restLength);
 
     // Calculate the final force and apply it.
-    force.normalize();
+    force = force.normalize();
     force *= -magnitude;
     particle->addForce(force);
 
@@ -6,6 +6,8 @@
 */
 
 #include "djinn/plinks.h"
+#include "djinn/parallel.h"
+#include "spdlog/spdlog.h"
 
 djinn::real djinn::ParticleLink::currentLength() const {
     djinn::Vec3 relativePos = particles[0]->getPosition() -
@@ -28,7 +30,7 @@ unsigned djinn::ParticleCable::addContact(djinn::ParticleContact *contact, unsig
 
     // Calculate the normal.
     djinn::Vec3 normal = particles[1]->getPosition() - particles[0]->getPosition();
-    normal.normalize();
+    normal = normal.normalize();
 
     contact->contactNormal = normal;
     contact->penetration = length-maxLength;
@@ -52,7 +54,7 @@ unsigned djinn::ParticleRod::addContact(djinn::ParticleContact *contact, unsigne
 
     // Calculate the normal.
     djinn::Vec3 normal = particles[1]->getPosition() - particles[0]->getPosition();
-    normal.normalize();
+    normal = normal.normalize();
 
     // The contact normal depends on whether we’re extending or compressing.
     if (currentLen > length) {
@@ -66,4 +68,88 @@ unsigned djinn::ParticleRod::addContact(djinn::ParticleContact *contact, unsigne
     // Always use zero restitution (no bounciness).
     contact->restitution = 0;
     return 1;
-}
\ No newline at end of file
+}
+
+unsigned djinn::ParticleLinkSet::indexOf(djinn::Particle *particle) {
+    auto found = index.find(particle);
+    if (found != index.end())
+        return found->second;
+
+    unsigned i = static_cast<unsigned>(particles.size());
+    index.emplace(particle, i);
+    particles.push_back(particle);
+    return i;
+}
+
+unsigned djinn::ParticleLinkSet::add(djinn::Particle *a, djinn::Particle *b, djinn::real length) {
+    first.push_back(indexOf(a));
+    second.push_back(indexOf(b));
+    lengths.push_back(length);
+
+    return size() - 1;
+}
+
+void djinn::ParticleLinkSet::clear() {
+    particles.clear();
+    index.clear();
+    first.clear();
+    second.clear();
+    lengths.clear();
+
+    spdlog::info("Cleared {} link set", kind == CABLE ? "cable" : "rod");
+}
+
+unsigned djinn::ParticleLinkSet::addContact(djinn::ParticleContact *contact, unsigned limit) const {
+    unsigned count = static_cast<unsigned>(particles.size());
+    unsigned links = size();
+    if (links == 0 || limit == 0)
+        return 0;
+
+    // Gather each particle's position once, however many links it is in
+    positions.resize(count);
+    djinn::parallelFor(count, [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned i = begin; i < end; i++) {
+            positions[i] = particles[i]->getPosition();
+        }
+    });
+
+    // Current length of every link
+    currentLengths.resize(links);
+    djinn::parallelFor(links, [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned l = begin; l < end; l++) {
+            currentLengths[l] = (positions[second[l]] - positions[first[l]]).magnitude();
+        }
+    });
+
+    // Write the violated links, in order
+    unsigned used = 0;
+    for (unsigned l = 0; l < links && used < limit; l++) {
+        djinn::real length = currentLengths[l];
+        djinn::real target = lengths[l];
+
+        // Slack cables and rods at exactly their length need nothing
+        if (kind == CABLE ? length < target : length == target)
+            continue;
+
+        djinn::ParticleContact &c = contact[used++];
+        c.particles[0] = particles[first[l]];
+        c.particles[1] = particles[second[l]];
+
+        djinn::Vec3 normal = positions[second[l]] - positions[first[l]];
+        if (length > 0)
+            normal *= 1 / length;
+
+        // Extended links pull the particles together, compressed rods push them apart
+        if (length > target) {
+            c.contactNormal = normal;
+            c.penetration = length - target;
+        } else {
+            c.contactNormal = normal * -1;
+            c.penetration = target - length;
+        }
+
+        c.restitution = (kind == CABLE) ? restitution : 0;
+    }
+
+    return used;
+}
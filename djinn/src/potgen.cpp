@@ -7,6 +7,8 @@
 #include "djinn/potgen.h"
 #include "djinn/numerical.h"
 #include "spdlog/spdlog.h"
+#include <algorithm>
+#include <assert.h>
 #include <cmath>
 
 void djinn::PotentialRegistry::add(djinn::Particle *particle, djinn::PotentialGenerator *pg) {
@@ -17,6 +19,7 @@ void djinn::PotentialRegistry::add(djinn::Particle *particle, djinn::PotentialGe
     // Don't add duplicates
     if (find(begin(registrations), end(registrations), registration) == end(registrations)) {
         registrations.push_back(registration);
+        neighbourList.invalidate();
 
         // Log registration
         spdlog::info("Added particle \"{}\" to potential registry", particle->getName());
@@ -32,6 +35,7 @@ void djinn::PotentialRegistry::remove(Particle *particle, PotentialGenerator *pg
     for (; i != registrations.end(); i++) {
         if (i->particle == particle && i->pg == pg) {
             registrations.erase(i);
+            neighbourList.invalidate();
             return;
         }
     }
@@ -48,18 +52,193 @@ void djinn::PotentialRegistry::integrateAll(djinn::real duration) {
 
 void djinn::PotentialRegistry::clear() {
     registrations.clear();
+    neighbourList.invalidate();
+}
+
+void djinn::PotentialRegistry::setPeriodicBox(const djinn::Vec3 &bounds, djinn::real cutoff) {
+    periodic = true;
+    cellList.setBox(bounds, cutoff);
+
+    if (useNeighbours)
+        neighbourList.setBox(bounds, cutoff, neighbourList.getSkin());
+
+    spdlog::info("Potential registry using a periodic box of {} with cutoff {} ({} cells)", bounds.toString(), cutoff, cellList.cellCount());
+}
+
+void djinn::PotentialRegistry::useNeighbourList(djinn::real skin) {
+    assert(periodic);
+
+    useNeighbours = true;
+    neighbourList.setBox(cellList.getBounds(), cellList.getCutoff(), skin);
+
+    spdlog::info("Potential registry using a Verlet neighbour list (skin {})", skin);
+}
+
+void djinn::PotentialRegistry::applyPair(unsigned i, unsigned j, const djinn::Vec3 &r, djinn::real rSq, djinn::real dvar) {
+    // Coincident particles have no defined direction between them
+    if (rSq <= 0)
+        return;
+
+    djinn::real rMag = real_sqrt(rSq);
+
+    // Apply force to particle i, and the equal and opposite force to particle j
+    registrations[i].pg->updateForce(registrations[i].particle, r, rMag, dvar);
+    registrations[j].pg->updateForce(registrations[j].particle, r * -1.0, rMag, dvar);
+}
+
+void djinn::PotentialRegistry::queuePair(unsigned thread, unsigned i, unsigned j, const djinn::Vec3 &r, djinn::real rSq) {
+    // Coincident particles have no defined direction between them, and resting pairs need no force
+    if (rSq <= 0 || (!moving[i] && !moving[j]))
+        return;
+
+    PairWorker &worker = workers[thread];
+    djinn::PotentialGenerator *pg = registrations[i].pg;
+
+    if (pg != registrations[j].pg) {
+        worker.mixedI.push_back(i);
+        worker.mixedJ.push_back(j);
+        worker.mixedR.push_back(r);
+        worker.mixedRSq.push_back(rSq);
+        return;
+    }
+
+    if (pg != worker.generator || worker.i.size() == BATCH_SIZE)
+        flushBatch(thread);
+
+    worker.generator = pg;
+    worker.i.push_back(i);
+    worker.j.push_back(j);
+    worker.r.push_back(r);
+    worker.rSq.push_back(rSq);
+}
+
+void djinn::PotentialRegistry::flushBatch(unsigned thread) {
+    PairWorker &worker = workers[thread];
+    if (worker.i.empty())
+        return;
+
+    djinn::PairBatch batch;
+    batch.i = worker.i.data();
+    batch.j = worker.j.data();
+    batch.r = worker.r.data();
+    batch.rSq = worker.rSq.data();
+    batch.count = static_cast<unsigned>(worker.i.size());
+
+    worker.energies.resize(batch.count);
+    worker.generator->evaluate(batch, accumulator.getForces(thread), worker.energies.data());
+
+    djinn::real &energy = accumulator.getEnergy(thread);
+    for (unsigned k = 0; k < batch.count; k++) {
+        energy += worker.energies[k];
+    }
+
+    worker.i.clear();
+    worker.j.clear();
+    worker.r.clear();
+    worker.rSq.clear();
+}
+
+void djinn::PotentialRegistry::updatePotentials(djinn::real duration) {
+    unsigned count = static_cast<unsigned>(registrations.size());
+
+    positions.resize(count);
+    moving.resize(count);
+    for (unsigned i = 0; i < count; i++) {
+        const djinn::Particle *p = registrations[i].particle;
+        positions[i] = p->getPosition();
+        moving[i] = p->getAwake() && p->hasFiniteMass();
+    }
+
+    unsigned threads = djinn::getThreadCount();
+    workers.resize(threads);
+    accumulator.reset(threads, count);
+
+    // Each thread searches its own share of the pairs and evaluates them into its own buffer
+    if (periodic && useNeighbours) {
+        neighbourList.update(positions.data(), count);
+        djinn::parallelFor(count, threads, [&](unsigned begin, unsigned end, unsigned thread) {
+            neighbourList.forEachPair(positions.data(), [&](unsigned i, unsigned j, const djinn::Vec3 &r, djinn::real rSq) {
+                queuePair(thread, i, j, r, rSq);
+            }, begin, end);
+            flushBatch(thread);
+        });
+    } else if (periodic) {
+        cellList.build(positions.data(), count);
+        djinn::parallelFor(cellList.cellCount(), threads, [&](unsigned begin, unsigned end, unsigned thread) {
+            cellList.forEachPair([&](unsigned i, unsigned j, const djinn::Vec3 &r, djinn::real rSq) {
+                queuePair(thread, i, j, r, rSq);
+            }, begin, end);
+            flushBatch(thread);
+        });
+    } else {
+        // Without a box there is nothing to bin against, so check every pair. Row i
+        // holds i pairs, so rows are split at i = count * sqrt(t / threads) to give
+        // every thread about the same number of pairs.
+        djinn::parallelFor(threads, threads, [&](unsigned t, unsigned, unsigned thread) {
+            unsigned begin = static_cast<unsigned>(count * real_sqrt((djinn::real)t / threads));
+            unsigned end = static_cast<unsigned>(count * real_sqrt((djinn::real)(t + 1) / threads));
+            if (t + 1 == threads)
+                end = count;
+
+            for (unsigned i = begin; i < end; i++) {
+                for (unsigned j = 0; j < i; j++) {
+                    djinn::Vec3 r = positions[i] - positions[j];
+                    queuePair(thread, i, j, r, r.squareMagnitude());
+                }
+            }
+            flushBatch(thread);
+        });
+    }
+
+    forces.resize(count);
+    potentialEnergy = accumulator.reduce(forces.data());
+
+    // Hand the summed forces to the particles. A sleeping particle only has force from moving
+    //      neighbours, which wakes it (a zero force doesn't)
+    for (unsigned i = 0; i < count; i++) {
+        registrations[i].particle->addForce(forces[i]);
+    }
+
+    // Pairs with mixed generators call into the particles directly, so they run here, in thread order
+    for (unsigned t = 0; t < threads; t++) {
+        PairWorker &worker = workers[t];
+
+        for (unsigned k = 0; k < worker.mixedI.size(); k++) {
+            applyPair(worker.mixedI[k], worker.mixedJ[k], worker.mixedR[k], worker.mixedRSq[k], duration);
+        }
+
+        worker.generator = nullptr;
+        worker.mixedI.clear();
+        worker.mixedJ.clear();
+        worker.mixedR.clear();
+        worker.mixedRSq.clear();
+    }
+}
+
+void djinn::PotentialGenerator::evaluate(const djinn::PairBatch &batch, djinn::Vec3 *forces, djinn::real *energies) const {
+    for (unsigned k = 0; k < batch.count; k++) {
+        djinn::real forceOverR, energy;
+        pairInteraction(batch.rSq[k], forceOverR, energy);
+
+        djinn::Vec3 force = batch.r[k] * forceOverR;
+        forces[batch.i[k]] += force;
+        forces[batch.j[k]] -= force;
+
+        if (energies)
+            energies[k] = energy;
+    }
 }
 
 
 void djinn::LennardJones::updatePotential(djinn::Particle *particle, djinn::real var) {
-    djinn::real sr6 = real_pow(sigma / var, 6);
-    particle->addPotential(4 * epsilon * (sr6 * sr6 - sr6));
+    djinn::real sr6 = real_pow(sig / var, 6);
+    particle->addPotential(4 * eps * (sr6 * sr6 - sr6));
 }
 
 // F = -grad(U)
 void djinn::LennardJones::updateForce(djinn::Particle *particle, djinn::Vec3 r_vec, djinn::real r_mag, djinn::real dvar) {
-    djinn::real sigma = 0.34;   // Lennard-Jones parameter
-    djinn::real epsilon = 0.38e-6; // Lennard-Jones parameter
+    djinn::real sigma = sig;
+    djinn::real epsilon = eps;
     djinn::real r2 = r_mag * r_mag;
     djinn::Vec3 r_hat = r_vec / r_mag;
 
@@ -73,3 +252,163 @@ void djinn::LennardJones::updateForce(djinn::Particle *particle, djinn::Vec3 r_v
 
     particle->addForce(force);
 }
+
+void djinn::LennardJones::pairInteraction(djinn::real rSq, djinn::real &forceOverR, djinn::real &energy) const {
+    djinn::real invRSq = 1 / rSq;
+    djinn::real u = sig * sig * invRSq;
+    djinn::real u3 = u * u * u;
+    djinn::real u6 = u3 * u3;
+
+    forceOverR = 24 * eps * invRSq * (2 * u6 - u3);
+    energy = 4 * eps * (u6 - u3);
+}
+
+void djinn::LennardJones::evaluate(const djinn::PairBatch &batch, djinn::Vec3 *forces, djinn::real *energies) const {
+    const djinn::real sigmaSq = sig * sig;
+
+    // Work through the batch in chunks: the scalar part of every pair is computed
+    // in one branch-free (vectorizable) loop, then scattered into the force array
+    const unsigned CHUNK = 128;
+    djinn::real forceOverR[CHUNK];
+    djinn::real energy[CHUNK];
+
+    for (unsigned start = 0; start < batch.count; start += CHUNK) {
+        unsigned n = std::min(CHUNK, batch.count - start);
+        const djinn::real *rSq = batch.rSq + start;
+
+        for (unsigned k = 0; k < n; k++) {
+            djinn::real invRSq = 1 / rSq[k];
+            djinn::real u = sigmaSq * invRSq;
+            djinn::real u3 = u * u * u;
+            djinn::real u6 = u3 * u3;
+
+            forceOverR[k] = 24 * eps * invRSq * (2 * u6 - u3);
+            energy[k] = 4 * eps * (u6 - u3);
+        }
+
+        for (unsigned k = 0; k < n; k++) {
+            djinn::Vec3 force = batch.r[start + k] * forceOverR[k];
+            forces[batch.i[start + k]] += force;
+            forces[batch.j[start + k]] -= force;
+        }
+
+        if (energies) {
+            for (unsigned k = 0; k < n; k++)
+                energies[start + k] = energy[k];
+        }
+    }
+}
+
+djinn::TabulatedPotential::TabulatedPotential(const djinn::PotentialGenerator &source, djinn::real rMin,
+                                              djinn::real cutoff, unsigned intervals) {
+    assert(rMin > 0 && cutoff > rMin);
+    assert(intervals > 0);
+
+    rMinSq = rMin * rMin;
+    cutoffSq = cutoff * cutoff;
+    inverseSpacing = intervals / (cutoffSq - rMinSq);
+
+    // Sample the source at every grid point
+    std::vector<djinn::real> forceSamples(intervals + 1);
+    std::vector<djinn::real> energySamples(intervals + 1);
+    for (unsigned k = 0; k <= intervals; k++) {
+        djinn::real rSq = rMinSq + k / inverseSpacing;
+        source.pairInteraction(rSq, forceSamples[k], energySamples[k]);
+    }
+
+    segments.resize(intervals);
+    fitSpline(forceSamples, &Segment::forceA, &Segment::forceB, &Segment::forceC, &Segment::forceD, segments);
+    fitSpline(energySamples, &Segment::energyA, &Segment::energyB, &Segment::energyC, &Segment::energyD, segments);
+
+    spdlog::info("Tabulated pair potential with {} intervals between r = {} and {}", intervals, rMin, cutoff);
+}
+
+void djinn::TabulatedPotential::fitSpline(const std::vector<djinn::real> &y, djinn::real Segment::*a,
+                                          djinn::real Segment::*b, djinn::real Segment::*c,
+                                          djinn::real Segment::*d, std::vector<Segment> &out) {
+    unsigned n = static_cast<unsigned>(y.size()) - 1;
+
+    // Second derivatives at the grid points (in units of one interval), from the
+    // tridiagonal system M[k-1] + 4 M[k] + M[k+1] = 6 (y[k-1] - 2 y[k] + y[k+1])
+    // with M[0] = M[n] = 0, solved with the Thomas algorithm
+    std::vector<djinn::real> M(n + 1, 0);
+    std::vector<djinn::real> diag(n + 1, 0);
+
+    for (unsigned k = 1; k < n; k++) {
+        djinn::real rhs = 6 * (y[k - 1] - 2 * y[k] + y[k + 1]);
+        diag[k] = 4;
+
+        if (k > 1) {
+            djinn::real w = 1 / diag[k - 1];
+            diag[k] -= w;
+            rhs -= w * M[k - 1];
+        }
+
+        M[k] = rhs;
+    }
+
+    for (unsigned k = n - 1; k >= 1; k--) {
+        M[k] = (M[k] - (k + 1 < n ? M[k + 1] : 0)) / diag[k];
+    }
+
+    for (unsigned k = 0; k < n; k++) {
+        out[k].*a = y[k];
+        out[k].*b = (y[k + 1] - y[k]) - (2 * M[k] + M[k + 1]) / 6;
+        out[k].*c = M[k] / 2;
+        out[k].*d = (M[k + 1] - M[k]) / 6;
+    }
+}
+
+void djinn::TabulatedPotential::updatePotential(djinn::Particle *particle, djinn::real var) {
+    djinn::real forceOverR, energy;
+    pairInteraction(var * var, forceOverR, energy);
+    particle->addPotential(energy);
+}
+
+void djinn::TabulatedPotential::updateForce(djinn::Particle *particle, djinn::Vec3 r_vec, djinn::real r_mag, djinn::real) {
+    djinn::real forceOverR, energy;
+    pairInteraction(r_mag * r_mag, forceOverR, energy);
+    particle->addForce(r_vec * forceOverR);
+}
+
+void djinn::TabulatedPotential::pairInteraction(djinn::real rSq, djinn::real &forceOverR, djinn::real &energy) const {
+    if (rSq >= cutoffSq) {
+        forceOverR = 0;
+        energy = 0;
+        return;
+    }
+
+    djinn::real t = std::max(rSq - rMinSq, (djinn::real)0) * inverseSpacing;
+    unsigned k = std::min(static_cast<unsigned>(t), static_cast<unsigned>(segments.size()) - 1);
+    t -= k;
+
+    const Segment &s = segments[k];
+    forceOverR = s.forceA + t * (s.forceB + t * (s.forceC + t * s.forceD));
+    energy = s.energyA + t * (s.energyB + t * (s.energyC + t * s.energyD));
+}
+
+void djinn::TabulatedPotential::evaluate(const djinn::PairBatch &batch, djinn::Vec3 *forces, djinn::real *energies) const {
+    // Same chunked layout as LennardJones::evaluate: table lookups first, then the scatter
+    const unsigned CHUNK = 128;
+    djinn::real forceOverR[CHUNK];
+    djinn::real energy[CHUNK];
+
+    for (unsigned start = 0; start < batch.count; start += CHUNK) {
+        unsigned n = std::min(CHUNK, batch.count - start);
+
+        for (unsigned k = 0; k < n; k++) {
+            pairInteraction(batch.rSq[start + k], forceOverR[k], energy[k]);
+        }
+
+        for (unsigned k = 0; k < n; k++) {
+            djinn::Vec3 force = batch.r[start + k] * forceOverR[k];
+            forces[batch.i[start + k]] += force;
+            forces[batch.j[start + k]] -= force;
+        }
+
+        if (energies) {
+            for (unsigned k = 0; k < n; k++)
+                energies[start + k] = energy[k];
+        }
+    }
+}
@@ -0,0 +1,194 @@
+/**
+ * @file psprings.cpp
+ * @brief Define methods for spring networks
+ * @author Catyre
+ */
+
+#include "djinn/psprings.h"
+#include "spdlog/spdlog.h"
+#include <assert.h>
+
+namespace {
+    /**
+     * Force on the end at d (d = this end - other end) of a spring, adding
+     * its stored energy to energy. Returns a zero force for a slack bungee
+     * or a spring of zero length.
+     */
+    inline djinn::Vec3 springForce(const djinn::Vec3 &d, djinn::real stiffness, djinn::real restLength,
+                                   djinn::real elasticLimit, bool bungee, djinn::real &energy) {
+        djinn::real length = d.magnitude();
+        djinn::real stretch = length - restLength;
+        if (length <= 0 || (bungee && stretch <= 0))
+            return djinn::Vec3();
+
+        if (length >= elasticLimit)
+            stiffness *= 0.25;
+
+        energy += 0.5 * stiffness * stretch * stretch;
+        return d * (-stiffness * stretch / length);
+    }
+} // namespace
+
+unsigned djinn::SpringNetwork::indexOf(djinn::Particle *particle) {
+    auto found = index.find(particle);
+    if (found != index.end())
+        return found->second;
+
+    unsigned i = static_cast<unsigned>(particles.size());
+    index.emplace(particle, i);
+    particles.push_back(particle);
+    return i;
+}
+
+void djinn::SpringNetwork::add(djinn::Particle *a, djinn::Particle *b, djinn::real springConstant,
+                               djinn::real restLength, djinn::real elasticLimit) {
+    assert(a != b);
+
+    from.push_back(indexOf(a));
+    to.push_back(indexOf(b));
+    stiffness.push_back(springConstant);
+    restLengths.push_back(restLength);
+    elasticLimits.push_back(elasticLimit);
+    bungee.push_back(false);
+    dirty = true;
+}
+
+void djinn::SpringNetwork::addBungee(djinn::Particle *a, djinn::Particle *b, djinn::real springConstant,
+                                     djinn::real restLength) {
+    add(a, b, springConstant, restLength);
+    bungee.back() = true;
+}
+
+void djinn::SpringNetwork::addAnchored(djinn::Particle *particle, djinn::Vec3 *anchor, djinn::real springConstant,
+                                       djinn::real restLength, djinn::real elasticLimit) {
+    anchoredParticle.push_back(indexOf(particle));
+    anchors.push_back(anchor);
+    anchoredStiffness.push_back(springConstant);
+    anchoredRestLengths.push_back(restLength);
+    anchoredElasticLimits.push_back(elasticLimit);
+}
+
+void djinn::SpringNetwork::clear() {
+    particles.clear();
+    index.clear();
+    from.clear();
+    to.clear();
+    stiffness.clear();
+    restLengths.clear();
+    elasticLimits.clear();
+    bungee.clear();
+    firstSpring.clear();
+    anchoredParticle.clear();
+    anchors.clear();
+    anchoredStiffness.clear();
+    anchoredRestLengths.clear();
+    anchoredElasticLimits.clear();
+    dirty = false;
+}
+
+void djinn::SpringNetwork::build() {
+    unsigned count = static_cast<unsigned>(particles.size());
+    unsigned springs = size();
+
+    // Counting sort of the springs by the particle they start at, keeping the order they were added
+    firstSpring.assign(count + 1, 0);
+    for (unsigned s = 0; s < springs; s++) {
+        firstSpring[from[s] + 1]++;
+    }
+    for (unsigned i = 0; i < count; i++) {
+        firstSpring[i + 1] += firstSpring[i];
+    }
+
+    std::vector<unsigned> slot(springs);
+    std::vector<unsigned> cursor(firstSpring.begin(), firstSpring.end() - 1);
+    for (unsigned s = 0; s < springs; s++) {
+        slot[s] = cursor[from[s]]++;
+    }
+
+    std::vector<unsigned> sortedFrom(springs), sortedTo(springs);
+    std::vector<djinn::real> sortedStiffness(springs), sortedRestLengths(springs), sortedElasticLimits(springs);
+    std::vector<char> sortedBungee(springs);
+    for (unsigned s = 0; s < springs; s++) {
+        sortedFrom[slot[s]] = from[s];
+        sortedTo[slot[s]] = to[s];
+        sortedStiffness[slot[s]] = stiffness[s];
+        sortedRestLengths[slot[s]] = restLengths[s];
+        sortedElasticLimits[slot[s]] = elasticLimits[s];
+        sortedBungee[slot[s]] = bungee[s];
+    }
+
+    from.swap(sortedFrom);
+    to.swap(sortedTo);
+    stiffness.swap(sortedStiffness);
+    restLengths.swap(sortedRestLengths);
+    elasticLimits.swap(sortedElasticLimits);
+    bungee.swap(sortedBungee);
+
+    dirty = false;
+
+    spdlog::info("Built spring network of {} springs between {} particles", springs, count);
+}
+
+void djinn::SpringNetwork::updateForces(djinn::real) {
+    if (dirty)
+        build();
+
+    unsigned count = static_cast<unsigned>(particles.size());
+    if (count == 0)
+        return;
+
+    positions.resize(count);
+    moving.resize(count);
+    for (unsigned i = 0; i < count; i++) {
+        positions[i] = particles[i]->getPosition();
+        moving[i] = particles[i]->getAwake() && particles[i]->hasFiniteMass();
+    }
+
+    unsigned threads = djinn::getThreadCount();
+    accumulator.reset(threads, count);
+
+    // Each thread sweeps its own rows into its own buffer, so both ends of a spring can be written without locking
+    djinn::parallelFor(count, threads, [&](unsigned begin, unsigned end, unsigned thread) {
+        djinn::Vec3 *force = accumulator.getForces(thread);
+        djinn::real &energy = accumulator.getEnergy(thread);
+
+        for (unsigned i = begin; i < end; i++) {
+            for (unsigned s = firstSpring[i]; s < firstSpring[i + 1]; s++) {
+                unsigned j = to[s];
+                if (!moving[i] && !moving[j])
+                    continue;
+
+                djinn::Vec3 f = springForce(positions[i] - positions[j], stiffness[s], restLengths[s],
+                                            elasticLimits[s], bungee[s], energy);
+                force[i] += f;
+                force[j] -= f;
+            }
+        }
+    });
+
+    unsigned anchored = anchoredSize();
+    djinn::parallelFor(anchored, threads, [&](unsigned begin, unsigned end, unsigned thread) {
+        djinn::Vec3 *force = accumulator.getForces(thread);
+        djinn::real &energy = accumulator.getEnergy(thread);
+
+        for (unsigned s = begin; s < end; s++) {
+            unsigned i = anchoredParticle[s];
+            if (!moving[i])
+                continue;
+
+            force[i] += springForce(positions[i] - *anchors[s], anchoredStiffness[s], anchoredRestLengths[s],
+                                    anchoredElasticLimits[s], false, energy);
+        }
+    });
+
+    forces.resize(count);
+    potentialEnergy = accumulator.reduce(forces.data());
+
+    // A sleeping particle only has force from moving neighbours, which wakes it (a zero force doesn't)
+    for (unsigned i = 0; i < count; i++) {
+        particles[i]->addForce(forces[i]);
+    }
+
+    // Log force application (once per sweep; per-spring logging doesn't scale)
+    spdlog::info("Applied spring network forces ({} springs, {} anchored)", size(), anchored);
+}
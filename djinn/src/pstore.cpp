@@ -0,0 +1,195 @@
+/**
+ * @file pstore.cpp
+ * @brief Define methods for the structure-of-arrays particle store
+ * @author Catyre
+ */
+
+#include "djinn/pstore.h"
+#include "djinn/numerical.h"
+#include "djinn/parallel.h"
+#include <assert.h>
+#include <utility>
+
+djinn::ParticleStore::~ParticleStore() {
+    clear();
+}
+
+unsigned djinn::ParticleStore::add(const djinn::Particle &particle) {
+    return add(particle.position(), particle.velocity(), particle.acceleration(), particle.dampingRef(),
+               particle.inverseMassRef(), particle.name);
+}
+
+unsigned djinn::ParticleStore::add(const djinn::Vec3 &pos, const djinn::Vec3 &vel, const djinn::Vec3 &acc,
+                                   const djinn::real damping, const djinn::real inverseMass,
+                                   const std::string &name) {
+    positions.push_back(pos);
+    velocities.push_back(vel);
+    accelerations.push_back(acc);
+    netForces.push_back(djinn::Vec3());
+    inverseMasses.push_back(inverseMass);
+    dampings.push_back(damping);
+    names.push_back(name);
+    netPotentials.push_back(0);
+    owners.push_back(nullptr);
+    activeCount = size();
+
+    return size() - 1;
+}
+
+void djinn::ParticleStore::resize(unsigned count) {
+    // Bound particles past the new end take their state with them
+    while (size() > count) {
+        if (owners.back())
+            release(owners.back());
+        else
+            removeSlot(size() - 1);
+    }
+
+    positions.resize(count);
+    velocities.resize(count);
+    accelerations.resize(count);
+    netForces.resize(count);
+    inverseMasses.resize(count, 1);
+    dampings.resize(count, 1);
+    names.resize(count);
+    netPotentials.resize(count, 0);
+    owners.resize(count, nullptr);
+    activeCount = size();
+}
+
+void djinn::ParticleStore::clear() {
+    resize(0);
+}
+
+void djinn::ParticleStore::bind(const std::vector<djinn::Particle *> &particles) {
+    unsigned count = static_cast<unsigned>(particles.size());
+
+    // Every bound particle has a slot of its own, so if all of them are bound here and the
+    //      counts match, the store already holds exactly these particles
+    bool bound = count == size();
+    for (unsigned i = 0; i < count && bound; i++)
+        bound = particles[i]->store == this;
+
+    if (bound)
+        return;
+
+    std::vector<char> listed(size(), 0);
+    for (const djinn::Particle *p : particles) {
+        if (p->store == this)
+            listed[p->slot] = 1;
+    }
+
+    // Going down, the slot moved into a freed one has already been kept
+    for (unsigned i = size(); i-- > 0;) {
+        if (listed[i])
+            continue;
+
+        if (owners[i])
+            release(owners[i]);
+        else
+            removeSlot(i);
+    }
+
+    for (djinn::Particle *p : particles) {
+        if (p->store == this)
+            continue;
+
+        if (p->store)
+            p->store->release(p);
+
+        add(p->pos, p->vel, p->acc, p->damping, p->inverseMass);
+        netForces.back() = p->netForce;
+        owners.back() = p;
+        p->store = this;
+        p->slot = size() - 1;
+    }
+
+    activeCount = size();
+}
+
+void djinn::ParticleStore::release(djinn::Particle *particle) {
+    assert(particle->store == this);
+
+    unsigned i = particle->slot;
+    particle->pos = positions[i];
+    particle->vel = velocities[i];
+    particle->acc = accelerations[i];
+    particle->netForce = netForces[i];
+    particle->inverseMass = inverseMasses[i];
+    particle->damping = dampings[i];
+    particle->store = nullptr;
+
+    owners[i] = nullptr;
+    removeSlot(i);
+}
+
+void djinn::ParticleStore::swapSlots(unsigned a, unsigned b) {
+    std::swap(positions[a], positions[b]);
+    std::swap(velocities[a], velocities[b]);
+    std::swap(accelerations[a], accelerations[b]);
+    std::swap(netForces[a], netForces[b]);
+    std::swap(inverseMasses[a], inverseMasses[b]);
+    std::swap(dampings[a], dampings[b]);
+    std::swap(names[a], names[b]);
+    std::swap(netPotentials[a], netPotentials[b]);
+    std::swap(owners[a], owners[b]);
+
+    if (owners[a])
+        owners[a]->slot = a;
+    if (owners[b])
+        owners[b]->slot = b;
+}
+
+void djinn::ParticleStore::removeSlot(unsigned index) {
+    unsigned last = size() - 1;
+    if (index != last)
+        swapSlots(index, last);
+
+    positions.pop_back();
+    velocities.pop_back();
+    accelerations.pop_back();
+    netForces.pop_back();
+    inverseMasses.pop_back();
+    dampings.pop_back();
+    names.pop_back();
+    netPotentials.pop_back();
+    owners.pop_back();
+    activeCount = size();
+}
+
+djinn::Particle djinn::ParticleStore::getParticle(unsigned index) const {
+    return djinn::Particle(positions[index], velocities[index], accelerations[index],
+                           dampings[index], inverseMasses[index], names[index]);
+}
+
+void djinn::ParticleStore::clearForces() {
+    for (unsigned i = 0; i < size(); i++) {
+        netForces[i].clear();
+    }
+}
+
+void djinn::ParticleStore::integrate(djinn::real duration) {
+    assert(duration > 0.0);
+
+    // Particles are independent here, so each block of them is integrated on its own
+    djinn::parallelFor(activeCount, [&](unsigned begin, unsigned end, unsigned) {
+        // Fold the net force into the acceleration of every particle with finite mass
+        for (unsigned i = begin; i < end; i++) {
+            if (inverseMasses[i] > 0.0)
+                accelerations[i].addScaledVector(netForces[i], inverseMasses[i]);
+        }
+
+        djinn::verletAlgorithm(positions.data() + begin, velocities.data() + begin, accelerations.data() + begin,
+                               inverseMasses.data() + begin, end - begin, duration);
+
+        // Particles with infinite mass keep their accumulators, as in Particle::integrate
+        for (unsigned i = begin; i < end; i++) {
+            if (inverseMasses[i] <= 0.0)
+                continue;
+
+            netForces[i].clear();
+            accelerations[i].clear();
+            netPotentials[i] = 0;
+        }
+    });
+}
@@ -1,74 +1,210 @@
+#include <algorithm>
 #include <cstddef>
+#include <djinn/numerical.h>
+#include <djinn/parallel.h>
 #include <djinn/pworld.h>
+#include <spdlog/spdlog.h>
 
 using namespace djinn;
 
 ParticleWorld::ParticleWorld(unsigned maxContacts, unsigned iterations)
-    : resolver(iterations),
-      maxContacts(maxContacts) {
-    contacts = new ParticleContact[maxContacts];
+    : integrator(nullptr),
+      forcesCarried(false),
+      resolver(iterations),
+      warmStarting(false),
+      constraintSolver(nullptr),
+      implicitSolver(nullptr),
+      rodSolver(nullptr),
+      continuousCollision(false),
+      sweepRestitution(0.5),
+      sweepRadius(0),
+      sleeping(false),
+      sleepEnergy(0),
+      sleepFrames(0),
+      maxContacts(std::max(1u, maxContacts)),
+      contactOverflows(0),
+      lastContactOverflows(0) {
     calculateIterations = (iterations == 0);
 }
 
-ParticleWorld::~ParticleWorld() {
-    delete[] contacts;
-}
+ParticleWorld::~ParticleWorld() {}
 
 void ParticleWorld::startFrame() {
-    for (Particles::iterator p = particles.begin();
-         p != particles.end();
-         p++) {
-        // Remove all forces from the accumulator
-        (*p)->clearNetForce();
-    }
+    // Picks up particles added or removed since the last frame
+    store.bind(particles);
+
+    // The integrator already evaluated this frame's forces
+    if (forcesCarried)
+        return;
+
+    // Remove all forces from the accumulators
+    store.clearForces();
 }
 
 unsigned ParticleWorld::generateContacts() {
-    unsigned limit = maxContacts;
-    ParticleContact *nextContact = contacts;
+    activeGenerators = contactGenerators;
+    if (rodSolver)
+        activeGenerators.push_back(rodSolver);
+
+    unsigned generators = static_cast<unsigned>(activeGenerators.size());
+
+    // Chunks keep their size between frames, so growth only happens while the
+    // scene is finding its feet
+    if (generatorContacts.size() != generators)
+        generatorContacts.resize(generators, std::vector<ParticleContact>(maxContacts));
+    generatorUsed.assign(generators, 0);
+
+    std::vector<unsigned> overflows(generators, 0);
+
+    // Generators are independent, so each runs as its own job (and may split
+    // its own work further)
+    parallelFor(generators, generators, [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned g = begin; g < end; g++) {
+            std::vector<ParticleContact> &chunk = generatorContacts[g];
+            unsigned used = activeGenerators[g]->addContact(chunk.data(), static_cast<unsigned>(chunk.size()));
+
+            // A full chunk may have cut the generator short: grow it and ask again
+            while (used == chunk.size()) {
+                overflows[g]++;
+                chunk.resize(2 * chunk.size());
+                used = activeGenerators[g]->addContact(chunk.data(), static_cast<unsigned>(chunk.size()));
+            }
 
-    for (ContactGenerators::iterator g = contactGenerators.begin();
-         g != contactGenerators.end();
-         g++) {
-        unsigned used = (*g)->addContact(nextContact, limit);
-        limit -= used;
-        nextContact += used;
+            generatorUsed[g] = used;
+        }
+    });
+
+    // Join the chunks in generator order
+    unsigned total = 0;
+    lastContactOverflows = 0;
+    for (unsigned g = 0; g < generators; g++) {
+        total += generatorUsed[g];
 
-        // We've run out of contacts to fill. This means we're missing
-        // contacts.
-        if (limit <= 0)
-            break;
+        if (overflows[g]) {
+            lastContactOverflows += overflows[g];
+            spdlog::info("Contact generator {} ran out of room {} time(s), now holds {} contacts", g, overflows[g],
+                         generatorContacts[g].size());
+        }
+    }
+    contactOverflows += lastContactOverflows;
+
+    if (contacts.size() < total)
+        contacts.resize(total);
+
+    unsigned next = 0;
+    for (unsigned g = 0; g < generators; g++) {
+        std::copy(generatorContacts[g].begin(), generatorContacts[g].begin() + generatorUsed[g],
+                  contacts.begin() + next);
+        next += generatorUsed[g];
+    }
+
+    // Contacts are new until the cache says otherwise
+    for (unsigned i = 0; i < total; i++) {
+        contacts[i].accumulatedImpulse = 0;
+        contacts[i].initialSeparatingVelocity = REAL_MAX;
     }
 
     // Return the number of contacts used.
-    return maxContacts - limit;
+    return total;
 }
 
 void ParticleWorld::integrate(real duration) {
-    for (Particles::iterator p = particles.begin();
-         p != particles.end();
-         p++) {
-        // Remove all forces from the accumulator
-        (*p)->integrate(duration);
+    // Sleeping particles stay where they are, and linked and spring-connected
+    // particles are left to their solvers; the rest are moved to the front
+    // of the store and integrated there in one pass
+    if (sleeping || constraintSolver || implicitSolver) {
+        store.activate([&](Particle *p) {
+            return p->getAwake() && !(constraintSolver && constraintSolver->owns(p)) &&
+                   !(implicitSolver && implicitSolver->owns(p));
+        });
+    } else {
+        store.activateAll();
     }
+
+    unsigned moving = store.getActiveCount();
+    if (continuousCollision && !staticColliders.empty()) {
+        startPositions.assign(store.getPositions(), store.getPositions() + moving);
+        startVelocities.assign(store.getVelocities(), store.getVelocities() + moving);
+
+        // The integrators clear the accelerations and forces, so keep what they step with
+        const Vec3 *accelerations = store.getAccelerations();
+        const Vec3 *netForces = store.getNetForces();
+        const real *inverseMasses = store.getInverseMasses();
+        startAccelerations.resize(moving);
+        for (unsigned i = 0; i < moving; i++) {
+            startAccelerations[i] = accelerations[i];
+            startAccelerations[i].addScaledVector(netForces[i], inverseMasses[i]);
+        }
+    }
+
+    if (integrator)
+        integrator->integrate(store, duration);
+    else
+        store.integrate(duration);
+
+    if (continuousCollision)
+        sweepStaticColliders(duration);
+
+    if (constraintSolver)
+        constraintSolver->step(duration);
+    if (implicitSolver)
+        implicitSolver->step(duration);
 }
 
-void ParticleWorld::runPhysics(real duration) {
-    // First apply the force generators
+void ParticleWorld::applyForces(real duration) {
     registry.updateForces(duration);
+    for (SpringNetwork *network : springNetworks) {
+        network->updateForces(duration);
+    }
+}
+
+void ParticleWorld::finishIntegration(real duration) {
+    applyForces(duration);
+    integrator->finish(store, duration);
+
+    // Sleeping particles get no forces, so with sleeping on the next step evaluates them afresh
+    forcesCarried = !sleeping;
+}
+
+void ParticleWorld::runPhysics(real duration) {
+    // Particles may have been added since startFrame()
+    store.bind(particles);
+
+    // First apply the force generators, unless the last step already did
+    if (!forcesCarried)
+        applyForces(duration);
+    forcesCarried = false;
 
     // Then integrate the objects
     integrate(duration);
+    if (integrator && integrator->isTwoPhase())
+        finishIntegration(duration);
+
+    // Put the rod assemblies back onto their links
+    if (rodSolver)
+        rodSolver->project();
 
     // Generate contacts
     unsigned usedContacts = generateContacts();
+    if (sleeping)
+        usedContacts = filterSleepingContacts(usedContacts);
 
     // And process them
     if (usedContacts) {
         if (calculateIterations)
             resolver.setIterations(usedContacts * 2);
-        resolver.resolveContacts(contacts, usedContacts, duration);
+        if (warmStarting)
+            contactCache.warmStart(contacts.data(), usedContacts);
+        resolver.resolveContacts(contacts.data(), usedContacts, duration);
     }
+
+    // Remember the impulses for next frame
+    if (warmStarting)
+        contactCache.store(contacts.data(), usedContacts);
+
+    // Put resting islands to sleep
+    if (sleeping)
+        updateSleeping(usedContacts);
 }
 
 ParticleWorld::Particles &ParticleWorld::getParticles() {
@@ -83,29 +219,361 @@ ParticleForceRegistry &ParticleWorld::getForceRegistry() {
     return registry;
 }
 
+ParticleWorld::SpringNetworks &ParticleWorld::getSpringNetworks() {
+    return springNetworks;
+}
+
+unsigned ParticleWorld::getContactOverflows() const {
+    return contactOverflows;
+}
+
+unsigned ParticleWorld::getLastContactOverflows() const {
+    return lastContactOverflows;
+}
+
+unsigned ParticleWorld::getContactCapacity() const {
+    unsigned capacity = 0;
+    for (const std::vector<ParticleContact> &chunk : generatorContacts) {
+        capacity += static_cast<unsigned>(chunk.size());
+    }
+    return capacity;
+}
+
+ParticleContactResolver &ParticleWorld::getContactResolver() {
+    return resolver;
+}
+
+void ParticleWorld::enableSleeping(real energyThreshold, unsigned frames) {
+    sleeping = true;
+    sleepEnergy = energyThreshold;
+    sleepFrames = frames;
+    restFrames.clear();
+}
+
+void ParticleWorld::disableSleeping() {
+    sleeping = false;
+    for (unsigned i = 0; i < particles.size(); i++) {
+        particles[i]->setAwake();
+    }
+}
+
+unsigned ParticleWorld::filterSleepingContacts(unsigned numContacts) {
+    // Awake here means free to move; immovable particles never wake anything
+    auto moving = [](const Particle *p) { return p && p->getAwake() && p->hasFiniteMass(); };
+
+    unsigned kept = 0;
+    for (unsigned i = 0; i < numContacts; i++) {
+        ParticleContact &contact = contacts[i];
+        if (!moving(contact.particles[0]) && !moving(contact.particles[1]))
+            continue;
+
+        // A new contact with an awake particle wakes a sleeping one
+        for (unsigned s = 0; s < 2; s++) {
+            if (contact.particles[s] && !contact.particles[s]->getAwake())
+                contact.particles[s]->setAwake();
+        }
+
+        if (kept != i)
+            contacts[kept] = contact;
+        kept++;
+    }
+
+    return kept;
+}
+
+unsigned ParticleWorld::findIsland(unsigned i) {
+    while (islandParent[i] != i) {
+        // Path halving keeps the trees flat
+        islandParent[i] = islandParent[islandParent[i]];
+        i = islandParent[i];
+    }
+    return i;
+}
+
+void ParticleWorld::updateSleeping(unsigned numContacts) {
+    unsigned count = static_cast<unsigned>(particles.size());
+
+    particleIndex.clear();
+    islandParent.resize(count);
+    for (unsigned i = 0; i < count; i++) {
+        particleIndex[particles[i]] = i;
+        islandParent[i] = i;
+    }
+
+    // Forget particles that have left the world
+    if (restFrames.size() > count) {
+        for (auto entry = restFrames.begin(); entry != restFrames.end();) {
+            if (particleIndex.count(entry->first) == 0)
+                entry = restFrames.erase(entry);
+            else
+                entry++;
+        }
+    }
+
+    // Immovable particles (the ground, anchors) don't join the islands they touch
+    auto join = [&](Particle *a, Particle *b) {
+        if (!a || !b || !a->hasFiniteMass() || !b->hasFiniteMass())
+            return;
+
+        auto ia = particleIndex.find(a);
+        auto ib = particleIndex.find(b);
+        if (ia == particleIndex.end() || ib == particleIndex.end())
+            return;
+
+        islandParent[findIsland(ia->second)] = findIsland(ib->second);
+    };
+
+    for (unsigned i = 0; i < numContacts; i++) {
+        join(contacts[i].particles[0], contacts[i].particles[1]);
+    }
+
+    for (ContactGenerators::iterator g = contactGenerators.begin(); g != contactGenerators.end(); g++) {
+        ParticleLink *link = dynamic_cast<ParticleLink *>(*g);
+        if (link)
+            join(link->particles[0], link->particles[1]);
+
+        ParticleLinkSet *set = dynamic_cast<ParticleLinkSet *>(*g);
+        if (set) {
+            for (unsigned l = 0; l < set->size(); l++) {
+                join(set->getParticle(l, 0), set->getParticle(l, 1));
+            }
+        }
+    }
+
+    // Springs tie their ends together as firmly as links do
+    for (unsigned r = 0; r < registry.size(); r++) {
+        join(registry.getParticle(r), registry.getGenerator(r)->getOther());
+    }
+
+    for (SpringNetwork *network : springNetworks) {
+        for (unsigned s = 0; s < network->size(); s++) {
+            join(network->getParticle(s, 0), network->getParticle(s, 1));
+        }
+    }
+
+    if (constraintSolver) {
+        for (ParticleLink *link : constraintSolver->getLinks()) {
+            join(link->particles[0], link->particles[1]);
+        }
+    }
+
+    if (rodSolver) {
+        for (unsigned l = 0; l < rodSolver->size(); l++) {
+            join(rodSolver->getParticle(l, 0), rodSolver->getParticle(l, 1));
+        }
+    }
+
+    // Total kinetic energy and size of every island, stored at its root
+    std::vector<real> islandEnergy(count, 0);
+    std::vector<unsigned> islandSize(count, 0);
+    for (unsigned i = 0; i < count; i++) {
+        Particle *p = particles[i];
+        if (!p->hasFiniteMass())
+            continue;
+
+        unsigned root = findIsland(i);
+        islandEnergy[root] += 0.5 * p->getMass() * p->getVelocity().squareMagnitude();
+        islandSize[root]++;
+    }
+
+    // An island is ready to sleep once every particle in it has rested long enough
+    std::vector<char> ready(count, 1);
+    for (unsigned i = 0; i < count; i++) {
+        Particle *p = particles[i];
+        if (!p->hasFiniteMass())
+            continue;
+
+        unsigned root = findIsland(i);
+        if (p->getAwake()) {
+            if (islandEnergy[root] < sleepEnergy * islandSize[root])
+                restFrames[p]++;
+            else
+                restFrames[p] = 0;
+        }
+
+        // Particles still asleep from earlier frames don't hold their island back
+        if (p->getAwake() && (!p->getCanSleep() || restFrames[p] < sleepFrames))
+            ready[root] = 0;
+    }
+
+    // Sleepers start counting afresh once something wakes them
+    for (unsigned i = 0; i < count; i++) {
+        Particle *p = particles[i];
+        if (p->hasFiniteMass() && p->getAwake() && ready[findIsland(i)]) {
+            p->setAwake(false);
+            restFrames[p] = 0;
+        }
+    }
+}
+
+void ParticleWorld::enableContinuousCollision(real restitution, real radius) {
+    continuousCollision = true;
+    sweepRestitution = restitution;
+    sweepRadius = radius;
+}
+
+void ParticleWorld::disableContinuousCollision() {
+    continuousCollision = false;
+}
+
+ParticleWorld::StaticColliders &ParticleWorld::getStaticColliders() {
+    return staticColliders;
+}
+
+void ParticleWorld::sweepStaticColliders(real duration) {
+    // A particle bouncing between colliders is stopped at its last hit after this many
+    const unsigned MAX_HITS = 4;
+
+    if (staticColliders.empty())
+        return;
+
+    Vec3 *positions = store.getPositions();
+    Vec3 *velocities = store.getVelocities();
+    const real *inverseMasses = store.getInverseMasses();
+
+    // The sweep works with the velocities at the positions' time, which some integrators'
+    //      velocities trail by part of a kick
+    real startLag = integrator ? integrator->startLag() * duration : 0;
+    real endLag = integrator ? integrator->endLag() * duration : 0;
+
+    parallelFor(store.getActiveCount(), [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned i = begin; i < end; i++) {
+            if (inverseMasses[i] <= 0.0)
+                continue;
+
+            // The acceleration the integrator stepped with, constant over the step
+            const Vec3 &acceleration = startAccelerations[i];
+
+            Vec3 start = startPositions[i];
+            Vec3 startVelocity = startVelocities[i] + acceleration * startLag;
+            Vec3 endVelocity = velocities[i] + acceleration * endLag;
+            real remaining = duration;
+            bool hit = false;
+
+            for (unsigned hits = 0; hits < MAX_HITS; hits++) {
+                // Earliest impact along the path
+                real first = 2;
+                Vec3 normal;
+                for (StaticCollider *collider : staticColliders) {
+                    real t;
+                    Vec3 n;
+                    if (collider->sweep(start, positions[i], sweepRadius, t, n) && t < first) {
+                        first = t;
+                        normal = n;
+                    }
+                }
+
+                if (first > 1)
+                    break;
+                hit = true;
+
+                // Advance to the moment of impact and bounce
+                Vec3 hitPosition = start + (positions[i] - start) * first;
+                Vec3 hitVelocity = startVelocity + (endVelocity - startVelocity) * first;
+
+                real approach = hitVelocity * normal;
+                if (approach < 0)
+                    hitVelocity.addScaledVector(normal, -(1 + sweepRestitution) * approach);
+
+                // Then let the integrator move it over the rest of the step from there
+                remaining *= 1 - first;
+                start = hitPosition;
+                startVelocity = hitVelocity;
+
+                positions[i] = hitPosition;
+                endVelocity = hitVelocity;
+                if (integrator)
+                    integrator->restep(positions[i], endVelocity, acceleration, remaining);
+                else
+                    verletAlgorithm(positions[i], endVelocity, acceleration, remaining);
+
+                // Out of hits; rest at the last point of impact
+                if (hits + 1 == MAX_HITS) {
+                    positions[i] = hitPosition;
+                    endVelocity = hitVelocity;
+                }
+            }
+
+            if (hit)
+                velocities[i] = endVelocity - acceleration * endLag;
+        }
+    });
+} // void ParticleWorld::sweepStaticColliders
+
+void ParticleWorld::setConstraintSolver(XPBDSolver *solver) {
+    constraintSolver = solver;
+}
+
+void ParticleWorld::setIntegrator(Integrator *integrator) {
+    this->integrator = integrator;
+    if (integrator)
+        integrator->reset();
+    forcesCarried = false;
+}
+
+void ParticleWorld::setImplicitSolver(ImplicitSpringSolver *solver) {
+    implicitSolver = solver;
+}
+
+void ParticleWorld::setRodSolver(RodChainSolver *solver) {
+    rodSolver = solver;
+}
+
+void ParticleWorld::useWarmStarting(real factor, real velocityTolerance, real penetrationTolerance) {
+    warmStarting = true;
+    contactCache.clear();
+    contactCache.setWarmStartFactor(factor);
+    resolver.setTolerance(velocityTolerance, penetrationTolerance);
+}
+
+ParticleStore &ParticleWorld::getStore() {
+    return store;
+}
+
 void GroundContacts::init(djinn::ParticleWorld::Particles *particles) {
     GroundContacts::particles = particles;
 }
 
 unsigned GroundContacts::addContact(djinn::ParticleContact *contact,
                                     unsigned limit) const {
-    unsigned count = 0;
-    for (djinn::ParticleWorld::Particles::iterator p = particles->begin();
-         p != particles->end();
-         p++) {
-        djinn::real y = (*p)->getPosition().y;
-        if (y < 0.0f) {
-            contact->contactNormal = djinn::Vec3(0, 1, 0);
-            contact->particles[0] = *p;
-            contact->particles[1] = NULL;
-            contact->penetration = -y;
-            contact->restitution = 0.2f;
-            contact++;
-            count++;
+    unsigned count = static_cast<unsigned>(particles->size());
+    unsigned blocks = getThreadCount();
+    std::vector<unsigned> offsets(blocks + 1, 0);
+
+    // Count the contacts in each block of particles first...
+    parallelFor(count, blocks, [&](unsigned begin, unsigned end, unsigned block) {
+        unsigned found = 0;
+        for (unsigned i = begin; i < end; i++) {
+            const djinn::Particle *p = (*particles)[i];
+            if (p->getAwake() && p->getPosition().y < 0.0f)
+                found++;
         }
+        offsets[block + 1] = found;
+    });
 
-        if (count >= limit)
-            return count;
+    // ...so every block knows where its contacts start, in the same order as a
+    // serial pass would write them
+    for (unsigned b = 0; b < blocks; b++) {
+        offsets[b + 1] += offsets[b];
     }
-    return count;
+
+    parallelFor(count, blocks, [&](unsigned begin, unsigned end, unsigned block) {
+        unsigned next = offsets[block];
+        for (unsigned i = begin; i < end && next < limit; i++) {
+            djinn::Particle *p = (*particles)[i];
+            djinn::real y = p->getPosition().y;
+            // Sleeping particles rest where they are
+            if (p->getAwake() && y < 0.0f) {
+                djinn::ParticleContact *c = contact + next;
+                c->contactNormal = djinn::Vec3(0, 1, 0);
+                c->particles[0] = p;
+                c->particles[1] = NULL;
+                c->penetration = -y;
+                c->restitution = 0.2f;
+                next++;
+            }
+        }
+    });
+
+    return std::min(offsets[blocks], limit);
 }
@@ -0,0 +1,441 @@
+/**
+ * @file rodsolver.cpp
+ * @brief Define methods for the direct (tree-structured) solver for chains of rods and cables
+ * @author Catyre
+ */
+
+#include "djinn/rodsolver.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <assert.h>
+
+void djinn::RodChainSolver::add(djinn::ParticleRod *rod) {
+    links.push_back({rod, false});
+    spdlog::info("Added rod between \"{}\" and \"{}\" to rod chain solver", rod->particles[0]->getName(),
+                 rod->particles[1]->getName());
+}
+
+void djinn::RodChainSolver::add(djinn::ParticleCable *cable) {
+    links.push_back({cable, true});
+    spdlog::info("Added cable between \"{}\" and \"{}\" to rod chain solver", cable->particles[0]->getName(),
+                 cable->particles[1]->getName());
+}
+
+void djinn::RodChainSolver::remove(djinn::ParticleLink *link) {
+    for (unsigned l = 0; l < links.size(); l++) {
+        if (links[l].link == link) {
+            links.erase(links.begin() + l);
+            return;
+        }
+    }
+}
+
+void djinn::RodChainSolver::clear() {
+    links.clear();
+    treeLeftover.clear();
+    leftover.clear();
+}
+
+unsigned djinn::RodChainSolver::nodeOf(djinn::Particle *particle) {
+    if (!particle->hasFiniteMass() || !particle->getAwake())
+        return NONE;
+
+    auto found = particleIndex.find(particle);
+    if (found != particleIndex.end())
+        return found->second;
+
+    unsigned i = static_cast<unsigned>(particles.size());
+    particleIndex.emplace(particle, i);
+    particles.push_back(particle);
+    return i;
+}
+
+void djinn::RodChainSolver::gatherConstraints(bool velocities) {
+    particles.clear();
+    particleIndex.clear();
+    constraints.clear();
+
+    for (unsigned l = 0; l < links.size(); l++) {
+        const Link &link = links[l];
+        djinn::Particle *pa = link.link->particles[0];
+        djinn::Particle *pb = link.link->particles[1];
+
+        djinn::Vec3 d = pa->getPosition() - pb->getPosition();
+        djinn::real length = d.magnitude();
+        if (length <= 0)
+            continue;
+
+        djinn::Vec3 normal = d * (1 / length);
+        djinn::real error;
+
+        if (link.cable) {
+            const djinn::ParticleCable *cable = static_cast<const djinn::ParticleCable *>(link.link);
+            error = length - cable->maxLength;
+
+            // Slack cables exert nothing; taut ones only stop the particles separating
+            if (error < 0)
+                continue;
+            if (velocities && (pa->getVelocity() - pb->getVelocity()) * normal <= 0)
+                continue;
+        } else {
+            error = length - static_cast<const djinn::ParticleRod *>(link.link)->length;
+        }
+
+        Constraint c;
+        c.link = l;
+        c.a = nodeOf(pa);
+        c.b = nodeOf(pb);
+        c.normal = normal;
+        c.error = error;
+
+        // Nothing to move
+        if (c.a == NONE && c.b == NONE)
+            continue;
+
+        constraints.push_back(c);
+    }
+}
+
+void djinn::RodChainSolver::buildTree() {
+    unsigned numParticles = static_cast<unsigned>(particles.size());
+    unsigned numConstraints = static_cast<unsigned>(constraints.size());
+    unsigned nodes = numParticles + numConstraints;
+
+    // Constraints of each particle
+    firstConstraint.assign(numParticles + 1, 0);
+    for (const Constraint &c : constraints) {
+        if (c.a != NONE)
+            firstConstraint[c.a + 1]++;
+        if (c.b != NONE)
+            firstConstraint[c.b + 1]++;
+    }
+    for (unsigned p = 0; p < numParticles; p++) {
+        firstConstraint[p + 1] += firstConstraint[p];
+    }
+
+    particleConstraints.resize(firstConstraint[numParticles]);
+    std::vector<unsigned> cursor(firstConstraint.begin(), firstConstraint.end() - 1);
+    for (unsigned c = 0; c < numConstraints; c++) {
+        if (constraints[c].a != NONE)
+            particleConstraints[cursor[constraints[c].a]++] = c;
+        if (constraints[c].b != NONE)
+            particleConstraints[cursor[constraints[c].b]++] = c;
+    }
+
+    parent.assign(nodes, NONE);
+    edge.resize(nodes);
+    order.clear();
+    order.reserve(nodes);
+    treeLeftover.clear();
+    solved.assign(numConstraints, 1);
+
+    std::vector<char> visited(nodes, 0);
+
+    // Jacobian entry of constraint c for particle p
+    auto jacobian = [&](unsigned c, unsigned p) {
+        return (constraints[c].a == p) ? constraints[c].normal : constraints[c].normal * -1;
+    };
+
+    auto leaveOut = [&](unsigned c) {
+        visited[numParticles + c] = 1;
+        solved[c] = 0;
+        treeLeftover.push_back(links[constraints[c].link].link);
+    };
+
+    // Claims constraint c as a child of particle p, with the particle at its other end as its child
+    auto claim = [&](unsigned c, unsigned p) {
+        unsigned node = numParticles + c;
+        unsigned other = (constraints[c].a == p) ? constraints[c].b : constraints[c].a;
+
+        // An immovable end would make the constraint a leaf with nothing to push against,
+        // and a visited one would close a loop
+        if (other == NONE || visited[other]) {
+            leaveOut(c);
+            return;
+        }
+
+        visited[node] = 1;
+        parent[node] = p;
+        edge[node] = jacobian(c, p);
+
+        visited[other] = 1;
+        parent[other] = node;
+        edge[other] = jacobian(c, other);
+    };
+
+    auto grow = [&](unsigned root) {
+        // The order list doubles as the breadth-first queue
+        unsigned head = static_cast<unsigned>(order.size());
+        order.push_back(root);
+
+        while (head < order.size()) {
+            unsigned node = order[head++];
+
+            if (node >= numParticles) {
+                // A constraint's children are the particles it claimed
+                const Constraint &c = constraints[node - numParticles];
+                if (c.a != NONE && parent[c.a] == node)
+                    order.push_back(c.a);
+                if (c.b != NONE && parent[c.b] == node)
+                    order.push_back(c.b);
+                continue;
+            }
+
+            for (unsigned k = firstConstraint[node]; k < firstConstraint[node + 1]; k++) {
+                unsigned c = particleConstraints[k];
+                if (visited[numParticles + c])
+                    continue;
+
+                claim(c, node);
+                if (parent[numParticles + c] == node)
+                    order.push_back(numParticles + c);
+            }
+        }
+    };
+
+    // Components tied to an immovable particle are rooted at that link
+    for (unsigned c = 0; c < numConstraints; c++) {
+        const Constraint &constraint = constraints[c];
+        if (constraint.a != NONE && constraint.b != NONE)
+            continue;
+
+        unsigned node = numParticles + c;
+        if (visited[node])
+            continue;
+
+        unsigned p = (constraint.a != NONE) ? constraint.a : constraint.b;
+        if (visited[p]) {
+            // Second anchor of a component that already has a root
+            leaveOut(c);
+            continue;
+        }
+
+        visited[node] = 1;
+        visited[p] = 1;
+        parent[p] = node;
+        edge[p] = jacobian(c, p);
+        grow(node);
+    }
+
+    // Free-floating components are rooted at any particle
+    for (unsigned p = 0; p < numParticles; p++) {
+        if (visited[p])
+            continue;
+
+        visited[p] = 1;
+        grow(p);
+    }
+}
+
+djinn::Vec3 djinn::RodChainSolver::multiply(const Block &m, const djinn::Vec3 &v) {
+    return djinn::Vec3(m.xx * v.x + m.xy * v.y + m.xz * v.z,
+                       m.xy * v.x + m.yy * v.y + m.yz * v.z,
+                       m.xz * v.x + m.yz * v.y + m.zz * v.z);
+}
+
+djinn::RodChainSolver::Block djinn::RodChainSolver::inverse(const Block &m) {
+    // Cofactors of a symmetric matrix
+    djinn::real cxx = m.yy * m.zz - m.yz * m.yz;
+    djinn::real cxy = m.xz * m.yz - m.xy * m.zz;
+    djinn::real cxz = m.xy * m.yz - m.xz * m.yy;
+    djinn::real determinant = m.xx * cxx + m.xy * cxy + m.xz * cxz;
+    assert(determinant > 0);
+
+    djinn::real s = 1 / determinant;
+    return {cxx * s,
+            cxy * s,
+            cxz * s,
+            (m.xx * m.zz - m.xz * m.xz) * s,
+            (m.xy * m.xz - m.xx * m.yz) * s,
+            (m.xx * m.yy - m.xy * m.xy) * s};
+}
+
+void djinn::RodChainSolver::factor() {
+    unsigned numParticles = static_cast<unsigned>(particles.size());
+
+    std::vector<Block> diagonal(numParticles);
+    for (unsigned p = 0; p < numParticles; p++) {
+        djinn::real m = particles[p]->getMass();
+        diagonal[p] = {m, 0, 0, m, 0, m};
+    }
+    particleInverse.resize(numParticles);
+    constraintDiagonal.assign(constraints.size(), 0);
+
+    // Children before parents: each finished node folds itself into its parent
+    for (unsigned k = static_cast<unsigned>(order.size()); k-- > 0;) {
+        unsigned node = order[k];
+        unsigned up = parent[node];
+        const djinn::Vec3 &e = edge[node];
+
+        if (node < numParticles) {
+            particleInverse[node] = inverse(diagonal[node]);
+            if (up != NONE)
+                constraintDiagonal[up - numParticles] -= e * multiply(particleInverse[node], e);
+        } else if (up != NONE) {
+            djinn::real s = -1 / constraintDiagonal[node - numParticles];
+            Block &d = diagonal[up];
+            d.xx += s * e.x * e.x;
+            d.xy += s * e.x * e.y;
+            d.xz += s * e.x * e.z;
+            d.yy += s * e.y * e.y;
+            d.yz += s * e.y * e.z;
+            d.zz += s * e.z * e.z;
+        }
+    }
+}
+
+void djinn::RodChainSolver::solve() {
+    unsigned numParticles = static_cast<unsigned>(particles.size());
+    particleValues.assign(numParticles, djinn::Vec3());
+
+    // Forward substitution, children before parents
+    for (unsigned k = static_cast<unsigned>(order.size()); k-- > 0;) {
+        unsigned node = order[k];
+        unsigned up = parent[node];
+        if (up == NONE)
+            continue;
+
+        if (node < numParticles)
+            constraintValues[up - numParticles] += edge[node] * multiply(particleInverse[node], particleValues[node]);
+        else
+            particleValues[up].addScaledVector(edge[node], constraintValues[node - numParticles] /
+                                                                constraintDiagonal[node - numParticles]);
+    }
+
+    // Back substitution, parents before children
+    for (unsigned node : order) {
+        unsigned up = parent[node];
+
+        if (node < numParticles) {
+            djinn::Vec3 y = particleValues[node];
+            if (up != NONE)
+                y.addScaledVector(edge[node], constraintValues[up - numParticles]);
+            particleValues[node] = multiply(particleInverse[node], y);
+        } else {
+            unsigned c = node - numParticles;
+            djinn::real y = constraintValues[c];
+            if (up != NONE)
+                y += edge[node] * particleValues[up];
+            constraintValues[c] = y / constraintDiagonal[c];
+        }
+    }
+}
+
+djinn::real djinn::RodChainSolver::linkError(const Link &link) {
+    djinn::real length = (link.link->particles[0]->getPosition() - link.link->particles[1]->getPosition()).magnitude();
+    if (link.cable)
+        return std::max(length - static_cast<const djinn::ParticleCable *>(link.link)->maxLength, djinn::real(0));
+    return real_abs(length - static_cast<const djinn::ParticleRod *>(link.link)->length);
+}
+
+djinn::real djinn::RodChainSolver::treeError(bool squared) const {
+    djinn::real worst = 0;
+    djinn::real sum = 0;
+    for (unsigned c = 0; c < constraints.size(); c++) {
+        if (!solved[c])
+            continue;
+
+        djinn::real error = linkError(links[constraints[c].link]);
+        worst = std::max(worst, error);
+        sum += error * error;
+    }
+
+    return squared ? sum : worst;
+}
+
+void djinn::RodChainSolver::project() {
+    // Halvings of a Newton step that made things worse before giving up on it
+    const unsigned MAX_HALVINGS = 4;
+
+    leftover.clear();
+
+    // Newton steps on the link lengths
+    for (unsigned iteration = 0; iteration < positionIterations; iteration++) {
+        gatherConstraints(false);
+        if (constraints.empty())
+            break;
+
+        buildTree();
+        if (iteration == 0)
+            leftover = treeLeftover;
+
+        if (treeError(false) <= tolerance)
+            break;
+        djinn::real before = treeError(true);
+
+        factor();
+
+        constraintValues.resize(constraints.size());
+        for (unsigned c = 0; c < constraints.size(); c++) {
+            constraintValues[c] = constraints[c].error;
+        }
+        solve();
+
+        startPositions.resize(particles.size());
+        for (unsigned p = 0; p < particles.size(); p++) {
+            startPositions[p] = particles[p]->getPosition();
+        }
+
+        // Far from the links (e.g. the tip of a whipping chain) the linearization can
+        //      overshoot, so back off until the step helps
+        djinn::real step = 1;
+        bool improved = false;
+        for (unsigned halving = 0; halving <= MAX_HALVINGS && !improved; halving++, step *= 0.5) {
+            for (unsigned p = 0; p < particles.size(); p++) {
+                particles[p]->setPosition(startPositions[p] + particleValues[p] * step);
+            }
+            improved = treeError(true) < before;
+        }
+
+        if (!improved) {
+            for (unsigned p = 0; p < particles.size(); p++) {
+                particles[p]->setPosition(startPositions[p]);
+            }
+            break;
+        }
+    }
+
+    // Links the Newton steps couldn't bring within the tolerance go to the iterative resolver too
+    for (unsigned c = 0; c < constraints.size(); c++) {
+        if (!solved[c])
+            continue;
+
+        const Link &link = links[constraints[c].link];
+        if (linkError(link) > tolerance)
+            leftover.push_back(link.link);
+    }
+
+    // Then take out the velocity along every link
+    gatherConstraints(true);
+    if (constraints.empty())
+        return;
+
+    buildTree();
+    if (positionIterations == 0)
+        leftover = treeLeftover;
+
+    factor();
+
+    constraintValues.resize(constraints.size());
+    for (unsigned c = 0; c < constraints.size(); c++) {
+        const Constraint &constraint = constraints[c];
+        const ParticleLink *link = links[constraint.link].link;
+        constraintValues[c] = (link->particles[0]->getVelocity() - link->particles[1]->getVelocity()) * constraint.normal;
+    }
+    solve();
+
+    for (unsigned p = 0; p < particles.size(); p++) {
+        particles[p]->setVelocity(particles[p]->getVelocity() + particleValues[p]);
+    }
+}
+
+unsigned djinn::RodChainSolver::addContact(djinn::ParticleContact *contact, unsigned limit) const {
+    unsigned used = 0;
+    for (const ParticleLink *link : leftover) {
+        if (used >= limit)
+            break;
+        used += link->addContact(contact + used, limit - used);
+    }
+
+    return used;
+}
@@ -0,0 +1,293 @@
+/**
+ * @file xpbd.cpp
+ * @brief Define methods for the position-based (XPBD) solver for cables and rods
+ * @author Catyre
+ */
+
+#include "djinn/xpbd.h"
+#include "djinn/parallel.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <assert.h>
+#include <cstdint>
+
+djinn::XPBDSolver::XPBDSolver(unsigned substeps, unsigned iterations)
+    : substeps(std::max(1u, substeps)), iterations(std::max(1u, iterations)), dirty(false) {}
+
+void djinn::XPBDSolver::add(djinn::ParticleLink *link, djinn::real compliance, bool cable) {
+    assert(compliance >= 0);
+
+    // Don't add duplicates
+    if (std::find(links.begin(), links.end(), link) != links.end()) {
+        spdlog::info("Link between \"{}\" and \"{}\" already in XPBD solver...discarding",
+                     link->particles[0]->getName(), link->particles[1]->getName());
+        return;
+    }
+
+    Constraint constraint;
+    constraint.link = link;
+    constraint.a = constraint.b = 0;
+    constraint.length = 0;
+    constraint.compliance = compliance;
+    constraint.cable = cable;
+    constraint.lambda = 0;
+
+    links.push_back(link);
+    constraints.push_back(constraint);
+    dirty = true;
+
+    // Log registration
+    spdlog::info("Added {} between \"{}\" and \"{}\" to XPBD solver (compliance {})", cable ? "cable" : "rod",
+                 link->particles[0]->getName(), link->particles[1]->getName(), compliance);
+}
+
+void djinn::XPBDSolver::add(djinn::ParticleCable *cable, djinn::real compliance) {
+    add(cable, compliance, true);
+}
+
+void djinn::XPBDSolver::add(djinn::ParticleRod *rod, djinn::real compliance) {
+    add(rod, compliance, false);
+}
+
+void djinn::XPBDSolver::remove(djinn::ParticleLink *link) {
+    for (unsigned c = 0; c < links.size(); c++) {
+        if (links[c] == link) {
+            links.erase(links.begin() + c);
+            constraints.erase(constraints.begin() + c);
+            dirty = true;
+            return;
+        }
+    }
+}
+
+void djinn::XPBDSolver::clear() {
+    links.clear();
+    constraints.clear();
+    dirty = true;
+}
+
+void djinn::XPBDSolver::setSubsteps(unsigned substeps) {
+    this->substeps = std::max(1u, substeps);
+}
+
+void djinn::XPBDSolver::setIterations(unsigned iterations) {
+    this->iterations = std::max(1u, iterations);
+}
+
+bool djinn::XPBDSolver::owns(const djinn::Particle *particle) {
+    // The world asks about every particle in turn, so build the index once
+    // rather than scanning the links for each of them
+    if (dirty)
+        build();
+
+    return index.count(particle) != 0;
+}
+
+void djinn::XPBDSolver::build() {
+    particles.clear();
+    index.clear();
+
+    for (Constraint &constraint : constraints) {
+        unsigned ends[2];
+        for (unsigned s = 0; s < 2; s++) {
+            djinn::Particle *p = constraint.link->particles[s];
+            auto found = index.find(p);
+            if (found == index.end()) {
+                found = index.emplace(p, static_cast<unsigned>(particles.size())).first;
+                particles.push_back(p);
+            }
+            ends[s] = found->second;
+        }
+        constraint.a = ends[0];
+        constraint.b = ends[1];
+    }
+
+    // Greedy coloring with one bit per color at each particle. Only particles
+    // with finite mass are written to, so anchors don't use up colors. Links
+    // that find all 64 colors taken go into a last batch solved serially.
+    const unsigned SERIAL = 64;
+    unsigned count = static_cast<unsigned>(constraints.size());
+    std::vector<uint64_t> taken(particles.size(), 0);
+    std::vector<unsigned> colors(count);
+
+    colorStart.assign(SERIAL + 2, 0);
+
+    for (unsigned c = 0; c < count; c++) {
+        const Constraint &constraint = constraints[c];
+        bool moves[2] = {particles[constraint.a]->hasFiniteMass(), particles[constraint.b]->hasFiniteMass()};
+        unsigned ends[2] = {constraint.a, constraint.b};
+
+        uint64_t used = 0;
+        for (unsigned s = 0; s < 2; s++) {
+            if (moves[s])
+                used |= taken[ends[s]];
+        }
+
+        unsigned color = SERIAL;
+        if (~used) {
+            color = 0;
+            while (used & (uint64_t(1) << color))
+                color++;
+
+            for (unsigned s = 0; s < 2; s++) {
+                if (moves[s])
+                    taken[ends[s]] |= uint64_t(1) << color;
+            }
+        }
+
+        colors[c] = color;
+        colorStart[color + 1]++;
+    }
+
+    // Counting sort of the links by color, keeping index order within each color
+    for (unsigned k = 0; k <= SERIAL; k++) {
+        colorStart[k + 1] += colorStart[k];
+    }
+
+    colorOrder.resize(count);
+    std::vector<unsigned> cursor(colorStart.begin(), colorStart.end() - 1);
+    for (unsigned c = 0; c < count; c++) {
+        colorOrder[cursor[colors[c]]++] = c;
+    }
+
+    dirty = false;
+}
+
+void djinn::XPBDSolver::solve(Constraint &constraint, djinn::real alphaTilde) {
+    djinn::real wa = inverseMasses[constraint.a];
+    djinn::real wb = inverseMasses[constraint.b];
+    djinn::real w = wa + wb;
+    if (w <= 0)
+        return;
+
+    djinn::Vec3 d = positions[constraint.a] - positions[constraint.b];
+    djinn::real length = d.magnitude();
+    if (length <= 0)
+        return;
+
+    djinn::real c = length - constraint.length;
+
+    // A slack cable exerts no force
+    if (constraint.cable && c <= 0 && constraint.lambda == 0)
+        return;
+
+    djinn::real deltaLambda = (-c - alphaTilde * constraint.lambda) / (w + alphaTilde);
+
+    // Cables can pull but never push
+    if (constraint.cable && constraint.lambda + deltaLambda > 0)
+        deltaLambda = -constraint.lambda;
+
+    constraint.lambda += deltaLambda;
+
+    djinn::Vec3 n = d * (1 / length);
+    if (wa > 0)
+        positions[constraint.a].addScaledVector(n, deltaLambda * wa);
+    if (wb > 0)
+        positions[constraint.b].addScaledVector(n, -deltaLambda * wb);
+}
+
+void djinn::XPBDSolver::step(djinn::real duration) {
+    assert(duration > 0.0);
+
+    if (dirty)
+        build();
+
+    unsigned count = static_cast<unsigned>(particles.size());
+    if (count == 0)
+        return;
+
+    positions.resize(count);
+    previous.resize(count);
+    velocities.resize(count);
+    accelerations.resize(count);
+    inverseMasses.resize(count);
+
+    // Gather the particles; sleeping ones are held in place like anchors
+    djinn::parallelFor(count, [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned i = begin; i < end; i++) {
+            djinn::Particle *p = particles[i];
+            positions[i] = p->getPosition();
+            velocities[i] = p->getVelocity();
+            inverseMasses[i] = p->getAwake() ? p->getInverseMass() : 0;
+
+            accelerations[i] = p->getAcceleration();
+            if (inverseMasses[i] > 0)
+                accelerations[i].addScaledVector(p->getNetForce(), inverseMasses[i]);
+        }
+    });
+
+    // Lengths are read every step so links can be lengthened or shortened
+    for (Constraint &constraint : constraints) {
+        if (constraint.cable)
+            constraint.length = static_cast<const djinn::ParticleCable *>(constraint.link)->maxLength;
+        else
+            constraint.length = static_cast<const djinn::ParticleRod *>(constraint.link)->length;
+    }
+
+    const djinn::real h = duration / substeps;
+    const unsigned colorCount = static_cast<unsigned>(colorStart.size()) - 1;
+    const unsigned serialColor = colorCount - 1;
+
+    for (unsigned s = 0; s < substeps; s++) {
+        // Predict the positions from the velocities and forces
+        djinn::parallelFor(count, [&](unsigned begin, unsigned end, unsigned) {
+            for (unsigned i = begin; i < end; i++) {
+                previous[i] = positions[i];
+                if (inverseMasses[i] <= 0)
+                    continue;
+
+                velocities[i].addScaledVector(accelerations[i], h);
+                positions[i].addScaledVector(velocities[i], h);
+            }
+        });
+
+        for (Constraint &constraint : constraints) {
+            constraint.lambda = 0;
+        }
+
+        for (unsigned iteration = 0; iteration < iterations; iteration++) {
+            for (unsigned color = 0; color < colorCount; color++) {
+                unsigned first = colorStart[color];
+                unsigned colorSize = colorStart[color + 1] - first;
+                if (colorSize == 0)
+                    continue;
+
+                // No two links of a color move the same particle, so they can be solved at once
+                auto solveRange = [&](unsigned begin, unsigned end, unsigned) {
+                    for (unsigned k = begin; k < end; k++) {
+                        Constraint &constraint = constraints[colorOrder[first + k]];
+                        solve(constraint, constraint.compliance / (h * h));
+                    }
+                };
+
+                if (color == serialColor)
+                    solveRange(0, colorSize, 0);
+                else
+                    djinn::parallelFor(colorSize, solveRange);
+            }
+        }
+
+        // The velocity is whatever moved the particle this substep
+        djinn::parallelFor(count, [&](unsigned begin, unsigned end, unsigned) {
+            for (unsigned i = begin; i < end; i++) {
+                if (inverseMasses[i] > 0)
+                    velocities[i] = (positions[i] - previous[i]) * (1 / h);
+            }
+        });
+    }
+
+    // Write the results back; like ParticleStore::integrate, only particles
+    // that moved have their accumulators cleared
+    djinn::parallelFor(count, [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned i = begin; i < end; i++) {
+            if (inverseMasses[i] <= 0)
+                continue;
+
+            djinn::Particle *p = particles[i];
+            p->setPosition(positions[i]);
+            p->setVelocity(velocities[i]);
+            p->clearNetForce();
+            p->setAcceleration(djinn::Vec3());
+        }
+    });
+} // void XPBDSolver::step